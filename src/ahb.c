@@ -7,108 +7,724 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define AHB_CHUNK (1 << 20)
 
-ssize_t ahb_siphon_out(struct ahb *ctx, uint32_t phys, ssize_t len, int outfd)
+bool ahb_stats_enabled;
+
+static const char *const ahb_op_names[ahb_op_max] = {
+	[ahb_op_read] = "read",
+	[ahb_op_write] = "write",
+	[ahb_op_readl] = "readl",
+	[ahb_op_writel] = "writel",
+	[ahb_op_readv] = "readv",
+	[ahb_op_writev] = "writev",
+};
+
+const char *ahb_op_name(enum ahb_op op)
 {
-	ssize_t ingress, egress;
-	void *chunk, *cursor;
-	int rc = 0;
+	return op < ahb_op_max ? ahb_op_names[op] : "unknown";
+}
+
+uint64_t ahb_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void ahb_stats_account(struct ahb *ctx, enum ahb_op op, uint64_t start,
+		       ssize_t bytes)
+{
+	struct ahb_op_stats *stats = &ctx->stats.op[op];
+	uint64_t ns = ahb_stats_now() - start;
+	unsigned int bucket;
+
+	bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+	if (bucket >= AHB_STATS_BUCKETS)
+		bucket = AHB_STATS_BUCKETS - 1;
+
+	stats->count++;
+	stats->ns += ns;
+	stats->hist[bucket]++;
+
+	if (bytes < 0)
+		stats->errors++;
+	else
+		stats->bytes += bytes;
+}
+
+static void ahb_stats_format_ns(char *buf, size_t len, uint64_t ns)
+{
+	if (ns < 1000)
+		snprintf(buf, len, "%" PRIu64 "ns", ns);
+	else if (ns < 1000000)
+		snprintf(buf, len, "%.1fus", ns / 1e3);
+	else if (ns < 1000000000)
+		snprintf(buf, len, "%.1fms", ns / 1e6);
+	else
+		snprintf(buf, len, "%.1fs", ns / 1e9);
+}
+
+void ahb_stats_report(struct ahb *ctx)
+{
+	char lower[16], upper[16], total[16], mean[16];
+	unsigned int bucket;
+	int op;
+
+	fprintf(stderr, "%s bridge statistics:\n", ctx->drv->name);
+	fprintf(stderr, "  %-8s %10s %8s %14s %12s %12s\n", "op", "count",
+		"errors", "bytes", "total", "mean");
+
+	for (op = 0; op < ahb_op_max; op++) {
+		const struct ahb_op_stats *stats = &ctx->stats.op[op];
+
+		if (!stats->count)
+			continue;
+
+		ahb_stats_format_ns(total, sizeof(total), stats->ns);
+		ahb_stats_format_ns(mean, sizeof(mean),
+				    stats->ns / stats->count);
+		fprintf(stderr,
+			"  %-8s %10" PRIu64 " %8" PRIu64 " %14" PRIu64
+			" %12s %12s\n",
+			ahb_op_names[op], stats->count, stats->errors,
+			stats->bytes, total, mean);
+	}
+
+	if (ctx->stats.remaps)
+		fprintf(stderr, "  window moves: %" PRIu64 "\n",
+			ctx->stats.remaps);
+	if (ctx->stats.batches)
+		fprintf(stderr, "  vectored batches: %" PRIu64 "\n",
+			ctx->stats.batches);
+
+	for (op = 0; op < ahb_op_max; op++) {
+		const struct ahb_op_stats *stats = &ctx->stats.op[op];
+
+		if (!stats->count)
+			continue;
+
+		fprintf(stderr, "  %s latency:\n", ahb_op_names[op]);
+		for (bucket = 0; bucket < AHB_STATS_BUCKETS; bucket++) {
+			if (!stats->hist[bucket])
+				continue;
+
+			ahb_stats_format_ns(lower, sizeof(lower),
+					    bucket ? 1ULL << (bucket - 1) : 0);
+			if (bucket < AHB_STATS_BUCKETS - 1)
+				ahb_stats_format_ns(upper, sizeof(upper),
+						    1ULL << bucket);
+			else
+				strcpy(upper, "...");
+
+			fprintf(stderr,
+				"    [%8s, %8s) %10" PRIu64 " %5.1f%%\n",
+				lower, upper, stats->hist[bucket],
+				100.0 * stats->hist[bucket] / stats->count);
+		}
+	}
+}
+
+size_t ahb_plan(const struct ahb *ctx, uint32_t phys, size_t len)
+{
+	const struct bridge_caps *caps = &ctx->drv->caps;
+	size_t chunk = len;
+	size_t limit;
+
+	if (caps->align > 1 && (phys & (caps->align - 1))) {
+		limit = caps->align - (phys & (caps->align - 1));
+		if (chunk > limit)
+			chunk = limit;
+	}
+
+	if (caps->window) {
+		limit = caps->window - (phys & (caps->window - 1));
+		if (chunk > limit)
+			chunk = limit;
+	}
+
+	if (caps->burst && chunk > caps->burst)
+		chunk = caps->burst;
+
+	return chunk;
+}
+
+ssize_t ahb_planned_read(struct ahb *ctx, uint32_t phys, void *buf,
+			 size_t len)
+{
+	size_t done, chunk;
+	ssize_t rc;
+
+	for (done = 0; done < len; done += rc) {
+		chunk = ahb_plan(ctx, phys + done, len - done);
+
+		rc = ctx->ops->read(ctx, phys + done, (uint8_t *)buf + done,
+				    chunk);
+		if (rc < 0)
+			return rc;
+
+		/* Don't leave a gap, report what was read contiguously */
+		if ((size_t)rc < chunk) {
+			done += rc;
+			return done ? (ssize_t)done : -EIO;
+		}
+	}
+
+	return len;
+}
+
+ssize_t ahb_planned_write(struct ahb *ctx, uint32_t phys, const void *buf,
+			  size_t len)
+{
+	size_t done, chunk;
+	ssize_t rc;
+
+	for (done = 0; done < len; done += rc) {
+		chunk = ahb_plan(ctx, phys + done, len - done);
+
+		rc = ctx->ops->write(ctx, phys + done,
+				     (const uint8_t *)buf + done, chunk);
+		if (rc < 0)
+			return rc;
+
+		if ((size_t)rc < chunk) {
+			done += rc;
+			return done ? (ssize_t)done : -EIO;
+		}
+	}
+
+	return len;
+}
+
+static int ahb_vec_validate(const struct ahb_vec *vec, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		const struct ahb_vec *v = &vec[i];
+
+		if (!(v->width == 1 || v->width == 2 || v->width == 4))
+			return -EINVAL;
+
+		if (v->phys & (v->width - 1))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int ahb_vec_read_one(struct ahb *ctx, struct ahb_vec *v)
+{
+	uint8_t buf[2];
+	ssize_t rc;
+
+	if (v->width == 4)
+		return ahb_readl(ctx, v->phys, &v->val);
+
+	rc = ahb_read(ctx, v->phys, buf, v->width);
+	if (rc < 0)
+		return rc;
+
+	if (rc != (ssize_t)v->width)
+		return -EIO;
+
+	v->val = buf[0];
+	if (v->width == 2)
+		v->val |= buf[1] << 8;
+
+	return 0;
+}
+
+static int ahb_vec_write_one(struct ahb *ctx, const struct ahb_vec *v)
+{
+	uint32_t full, val;
+	uint8_t buf[2];
+	ssize_t rc;
+
+	full = v->width == 4 ? 0xffffffff : ((1U << (8 * v->width)) - 1);
+	val = v->val & full;
+
+	if (v->mask && (v->mask & full) != full) {
+		struct ahb_vec cur = *v;
+
+		if ((rc = ahb_vec_read_one(ctx, &cur)) < 0)
+			return rc;
+
+		val = (cur.val & ~v->mask) | (val & v->mask);
+	}
+
+	if (v->width == 4)
+		return ahb_writel(ctx, v->phys, val);
+
+	buf[0] = val & 0xff;
+	buf[1] = (val >> 8) & 0xff;
+
+	rc = ahb_write(ctx, v->phys, buf, v->width);
+	if (rc < 0)
+		return rc;
+
+	return rc == (ssize_t)v->width ? 0 : -EIO;
+}
+
+static ssize_t ahb_vec_bytes(const struct ahb_vec *vec, size_t n)
+{
+	ssize_t bytes = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		bytes += vec[i].width;
+
+	return bytes;
+}
+
+int ahb_readv(struct ahb *ctx, struct ahb_vec *vec, size_t n)
+{
+	uint64_t start;
+	size_t i;
+	int rc;
+
+	if ((rc = ahb_vec_validate(vec, n)) < 0)
+		return rc;
+
+	if (!ctx->ops->readv) {
+		for (i = 0; i < n; i++) {
+			if ((rc = ahb_vec_read_one(ctx, &vec[i])) < 0)
+				return rc;
+		}
 
-	if (!len)
 		return 0;
+	}
 
-	chunk = malloc(AHB_CHUNK);
-	if (!chunk)
-		return -errno;
+	start = ahb_stats_start();
+	rc = ctx->ops->readv(ctx, vec, n);
+	if (start)
+		ahb_stats_account(ctx, ahb_op_readv, start,
+				  rc < 0 ? rc : ahb_vec_bytes(vec, n));
+	if (rc < 0)
+		return rc;
 
-	do {
-		ingress = (len > AHB_CHUNK || len == -1) ? AHB_CHUNK : len;
+	for (i = 0; i < n; i++) {
+		logt("%s: 0x%08" PRIx32 ": 0x%08" PRIx32 " (%" PRIu32 ")\n",
+		     __func__, vec[i].phys, vec[i].val, vec[i].width);
+	}
 
-		ingress = ahb_read(ctx, phys, chunk, ingress);
-		if (ingress < 0) {
-			rc = -EIO;
-			goto done;
+	return 0;
+}
+
+int ahb_writev(struct ahb *ctx, const struct ahb_vec *vec, size_t n)
+{
+	uint64_t start;
+	size_t i;
+	int rc;
+
+	if ((rc = ahb_vec_validate(vec, n)) < 0)
+		return rc;
+
+	if (!ctx->ops->writev) {
+		for (i = 0; i < n; i++) {
+			if ((rc = ahb_vec_write_one(ctx, &vec[i])) < 0)
+				return rc;
 		}
 
-		phys += ingress;
-		if (len > 0) {
-			len -= ingress;
+		return 0;
+	}
+
+	start = ahb_stats_start();
+	rc = ctx->ops->writev(ctx, vec, n);
+	if (start)
+		ahb_stats_account(ctx, ahb_op_writev, start,
+				  rc < 0 ? rc : ahb_vec_bytes(vec, n));
+	if (rc < 0)
+		return rc;
+
+	for (i = 0; i < n; i++) {
+		logt("%s: 0x%08" PRIx32 ": 0x%08" PRIx32 "/0x%08" PRIx32
+		     " (%" PRIu32 ")\n",
+		     __func__, vec[i].phys, vec[i].val, vec[i].mask,
+		     vec[i].width);
+	}
+
+	return 0;
+}
+
+/*
+ * The siphon is a two-stage pipeline: the calling thread drives the bridge
+ * while a helper thread performs the file I/O, exchanging chunks through a
+ * small ring of buffers. This lets slow bridge accesses overlap with output
+ * to pipes, compressors and network storage (and vice versa).
+ */
+#define AHB_SIPHON_DEPTH 4
+
+struct ahb_siphon {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	void *buf[AHB_SIPHON_DEPTH];
+	size_t used[AHB_SIPHON_DEPTH];
+	unsigned long head;
+	unsigned long tail;
+	bool eof;
+	int err;
+
+	/* Helper thread state */
+	int fd;
+	ssize_t len;
+};
+
+static int ahb_siphon_init(struct ahb_siphon *ctx, int fd, ssize_t len)
+{
+	int i, rc;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->fd = fd;
+	ctx->len = len;
+
+	for (i = 0; i < AHB_SIPHON_DEPTH; i++) {
+		if (!(ctx->buf[i] = malloc(AHB_CHUNK))) {
+			rc = -errno;
+			goto cleanup_bufs;
 		}
+	}
+
+	if ((rc = -pthread_mutex_init(&ctx->lock, NULL)))
+		goto cleanup_bufs;
+
+	if ((rc = -pthread_cond_init(&ctx->cond, NULL)))
+		goto cleanup_lock;
+
+	return 0;
+
+cleanup_lock:
+	pthread_mutex_destroy(&ctx->lock);
+
+cleanup_bufs:
+	while (i--)
+		free(ctx->buf[i]);
+
+	return rc;
+}
+
+static void ahb_siphon_destroy(struct ahb_siphon *ctx)
+{
+	int i;
 
-		cursor = chunk;
-		while (ingress) {
-			egress = write(outfd, cursor, ingress);
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->lock);
+
+	for (i = 0; i < AHB_SIPHON_DEPTH; i++)
+		free(ctx->buf[i]);
+}
+
+/* Returns NULL if the pipeline has failed */
+static void *ahb_siphon_get_empty(struct ahb_siphon *ctx)
+{
+	void *buf = NULL;
+
+	pthread_mutex_lock(&ctx->lock);
+	while (!ctx->err && ctx->head - ctx->tail == AHB_SIPHON_DEPTH)
+		pthread_cond_wait(&ctx->cond, &ctx->lock);
+
+	if (!ctx->err)
+		buf = ctx->buf[ctx->head % AHB_SIPHON_DEPTH];
+	pthread_mutex_unlock(&ctx->lock);
+
+	return buf;
+}
+
+static void ahb_siphon_put_full(struct ahb_siphon *ctx, size_t used)
+{
+	pthread_mutex_lock(&ctx->lock);
+	ctx->used[ctx->head % AHB_SIPHON_DEPTH] = used;
+	ctx->head++;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/* Returns NULL once the pipeline has drained or has failed */
+static void *ahb_siphon_get_full(struct ahb_siphon *ctx, size_t *used)
+{
+	void *buf = NULL;
+
+	pthread_mutex_lock(&ctx->lock);
+	while (!ctx->err && !ctx->eof && ctx->head == ctx->tail)
+		pthread_cond_wait(&ctx->cond, &ctx->lock);
+
+	if (!ctx->err && ctx->head != ctx->tail) {
+		buf = ctx->buf[ctx->tail % AHB_SIPHON_DEPTH];
+		*used = ctx->used[ctx->tail % AHB_SIPHON_DEPTH];
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	return buf;
+}
+
+static void ahb_siphon_put_empty(struct ahb_siphon *ctx)
+{
+	pthread_mutex_lock(&ctx->lock);
+	ctx->tail++;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void ahb_siphon_stop(struct ahb_siphon *ctx, int err)
+{
+	pthread_mutex_lock(&ctx->lock);
+	if (err && !ctx->err)
+		ctx->err = err;
+	ctx->eof = true;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/*
+ * The helper threads only accept cancellation while blocked in file I/O, so
+ * a bridge failure doesn't leave us waiting on e.g. a stalled pipe.
+ */
+static void *ahb_siphon_drain(void *arg)
+{
+	struct ahb_siphon *ctx = arg;
+	ssize_t egress;
+	void *cursor;
+	size_t used;
+	int rc = 0;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	while ((cursor = ahb_siphon_get_full(ctx, &used))) {
+		while (used) {
+			pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+			egress = write(ctx->fd, cursor, used);
+			pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 			if (egress == -1) {
 				rc = -errno;
 				goto done;
 			}
 
 			cursor += egress;
-			ingress -= egress;
+			used -= egress;
 		}
 
-		fprintf(stderr, ".");
-	} while (!!len);
+		ahb_siphon_put_empty(ctx);
+	}
 
 done:
-	fprintf(stderr, "\n");
-	free(chunk);
+	ahb_siphon_stop(ctx, rc);
 
-	return rc;
+	return NULL;
 }
 
-ssize_t ahb_siphon_in(struct ahb *ctx, uint32_t phys, ssize_t len, int infd)
+static void *ahb_siphon_fill(void *arg)
 {
-	ssize_t ingress, egress;
-	void *chunk;
+	struct ahb_siphon *ctx = arg;
+	ssize_t ingress;
+	size_t want;
+	void *buf;
 	int rc = 0;
 
-	chunk = malloc(AHB_CHUNK);
-	if (!chunk)
-		return -1;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
-	while ((ingress = read(infd, chunk,
-			       (len > AHB_CHUNK || len == -1) ? AHB_CHUNK :
-								len))) {
+	while ((buf = ahb_siphon_get_empty(ctx))) {
+		want = (ctx->len > AHB_CHUNK || ctx->len == -1) ? AHB_CHUNK :
+								  ctx->len;
+
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		ingress = read(ctx->fd, buf, want);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 		if (ingress < 0) {
 			rc = -errno;
-			goto done;
+			break;
 		}
 
-		egress = ahb_write(ctx, phys, chunk, ingress);
+		if (!ingress)
+			break;
+
+		ahb_siphon_put_full(ctx, ingress);
+
+		if (ctx->len > 0) {
+			ctx->len -= ingress;
+		}
+	}
+
+	ahb_siphon_stop(ctx, rc);
+
+	return NULL;
+}
+
+/*
+ * Write straight from the bridge's mapping, saving the copy through the
+ * bounce buffers. vmsplice() can't pin the PFN-mapped pages of /dev/mem, so a
+ * plain write() is as good as it gets. Advances @phys and @len over what was
+ * written, and returns -ENOTSUP if the rest should take the copy path.
+ */
+static int ahb_siphon_out_mapped(struct ahb *ctx, uint32_t *phys,
+				 ssize_t *len, int outfd)
+{
+	uint64_t start;
+	ssize_t egress;
+	size_t want;
+	void *src;
+
+	while (*len) {
+		want = *len > AHB_CHUNK ? AHB_CHUNK : *len;
+
+		start = ahb_stats_start();
+		if (!(src = ctx->ops->map(ctx, *phys, &want)))
+			return -ENOTSUP;
+
+		egress = write(outfd, src, want);
 		if (egress < 0) {
+			/* The kernel may refuse to copy from the mapping */
+			if (errno == EFAULT)
+				return -ENOTSUP;
+			return -errno;
+		}
+
+		if (start)
+			ahb_stats_account(ctx, ahb_op_read, start, egress);
+
+		*phys += egress;
+		*len -= egress;
+
+		fprintf(stderr, ".");
+	}
+
+	fprintf(stderr, "\n");
+
+	return 0;
+}
+
+ssize_t ahb_siphon_out(struct ahb *ctx, uint32_t phys, ssize_t len, int outfd)
+{
+	struct ahb_siphon siphon;
+	pthread_t drain;
+	ssize_t ingress;
+	void *chunk;
+	int rc;
+
+	if (!len)
+		return 0;
+
+	if (len > 0 && ctx->ops->map) {
+		rc = ahb_siphon_out_mapped(ctx, &phys, &len, outfd);
+		if (rc != -ENOTSUP)
+			return rc;
+
+		logd("Copying via bounce buffers from 0x%08" PRIx32 "\n",
+		     phys);
+	}
+
+	if ((rc = ahb_siphon_init(&siphon, outfd, len)))
+		return rc;
+
+	if ((rc = -pthread_create(&drain, NULL, ahb_siphon_drain, &siphon)))
+		goto cleanup_siphon;
+
+	do {
+		ingress = (len > AHB_CHUNK || len == -1) ? AHB_CHUNK : len;
+
+		/* NULL if the drain thread failed, we pick up its error below */
+		if (!(chunk = ahb_siphon_get_empty(&siphon)))
+			break;
+
+		ingress = ahb_read(ctx, phys, chunk, ingress);
+		if (ingress < 0) {
 			rc = -EIO;
-			goto done;
+			break;
 		}
 
+		ahb_siphon_put_full(&siphon, ingress);
+
 		phys += ingress;
 		if (len > 0) {
 			len -= ingress;
 		}
 
+		fprintf(stderr, ".");
+	} while (!!len);
+
+	ahb_siphon_stop(&siphon, rc);
+	if (rc)
+		pthread_cancel(drain);
+	pthread_join(drain, NULL);
+
+	if (!rc)
+		rc = siphon.err;
+
+	fprintf(stderr, "\n");
+
+cleanup_siphon:
+	ahb_siphon_destroy(&siphon);
+
+	return rc;
+}
+
+ssize_t ahb_siphon_in(struct ahb *ctx, uint32_t phys, ssize_t len, int infd)
+{
+	struct ahb_siphon siphon;
+	ssize_t egress;
+	pthread_t fill;
+	size_t used;
+	void *chunk;
+	int rc;
+
+	if ((rc = ahb_siphon_init(&siphon, infd, len)))
+		return rc;
+
+	if ((rc = -pthread_create(&fill, NULL, ahb_siphon_fill, &siphon)))
+		goto cleanup_siphon;
+
+	while ((chunk = ahb_siphon_get_full(&siphon, &used))) {
+		egress = ahb_write(ctx, phys, chunk, used);
+		if (egress < 0) {
+			rc = -EIO;
+			break;
+		}
+
+		ahb_siphon_put_empty(&siphon);
+
+		phys += used;
+
 		fprintf(stderr, ".");
 	}
 
-done:
+	if (rc) {
+		ahb_siphon_stop(&siphon, rc);
+		pthread_cancel(fill);
+	}
+	pthread_join(fill, NULL);
+
+	if (!rc)
+		rc = siphon.err;
+
 	fprintf(stderr, "\n");
-	free(chunk);
+
+cleanup_siphon:
+	ahb_siphon_destroy(&siphon);
 
 	return rc;
 }
 
 int ahb_release_bridge(struct ahb *ctx)
 {
+	/* The BMC may change state behind our back while we're released */
+	ctx->generation++;
+
 	return ctx->drv->release ? ctx->drv->release(ctx) : 0;
 }
 
 int ahb_reinit_bridge(struct ahb *ctx)
 {
+	ctx->generation++;
+
 	return ctx->drv->reinit ? ctx->drv->reinit(ctx) : 0;
 }
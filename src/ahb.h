@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
 struct ahb_range {
@@ -22,42 +23,161 @@ struct ahb_range {
 
 struct ahb;
 
+/*
+ * A single register access in a vectored transaction. @width is the access size
+ * in bytes (1, 2 or 4) and @phys must be naturally aligned to it.
+ *
+ * For ahb_readv() @val receives the value read. For ahb_writev() @val is the
+ * value to write, and a non-zero @mask limits the update to the selected bits
+ * by way of a read-modify-write.
+ */
+struct ahb_vec {
+	uint32_t phys;
+	uint32_t width;
+	uint32_t val;
+	uint32_t mask;
+};
+
+#define AHB_VEC_L(_phys, _val) { .phys = (_phys), .width = 4, .val = (_val) }
+
 struct ahb_ops {
 	ssize_t (*read)(struct ahb *ctx, uint32_t phys, void *buf, size_t len);
 	ssize_t (*write)(struct ahb *ctx, uint32_t phys, const void *buf,
 			 size_t len);
 	int (*readl)(struct ahb *ctx, uint32_t phys, uint32_t *val);
 	int (*writel)(struct ahb *ctx, uint32_t phys, uint32_t val);
+
+	/*
+	 * Optional: Perform a sequence of accesses as a single bridge
+	 * transaction.
+	 * ahb_readv() and ahb_writev() fall back to the scalar operations if the
+	 * bridge doesn't provide these.
+	 */
+	int (*readv)(struct ahb *ctx, struct ahb_vec *vec, size_t n);
+	int (*writev)(struct ahb *ctx, const struct ahb_vec *vec, size_t n);
+
+	/*
+	 * Optional: Expose the bridge's own mapping of @phys so that
+	 * ahb_siphon_out() can write it out without a bounce buffer. Returns
+	 * NULL if @phys can't be mapped, otherwise @len may be trimmed to what
+	 * the mapping covers. The pointer is only valid until the next access
+	 * through the bridge.
+	 */
+	void *(*map)(struct ahb *ctx, uint32_t phys, size_t *len);
+};
+
+enum ahb_op {
+	ahb_op_read,
+	ahb_op_write,
+	ahb_op_readl,
+	ahb_op_writel,
+	ahb_op_readv,
+	ahb_op_writev,
+	ahb_op_max,
+};
+
+/* Bucket n counts accesses taking [2^(n-1), 2^n) ns, the last takes the rest */
+#define AHB_STATS_BUCKETS 32
+
+struct ahb_op_stats {
+	uint64_t count;
+	uint64_t errors;
+	uint64_t bytes;
+	uint64_t ns;
+	uint64_t hist[AHB_STATS_BUCKETS];
+};
+
+struct ahb_stats {
+	struct ahb_op_stats op[ahb_op_max];
+	/* Maintained by bridges with a movable window, reported if non-zero */
+	uint64_t remaps;
+	uint64_t batches;
 };
 
 struct ahb {
 	const struct bridge_driver *drv;
 	const struct ahb_ops *ops;
+	struct ahb_stats stats;
+
+	/* Bumped whenever the bridge is released or reinitialised */
+	unsigned long generation;
 };
 
+/* Accounting is off unless requested, so the wrappers stay cheap */
+extern bool ahb_stats_enabled;
+
+const char *ahb_op_name(enum ahb_op op);
+
+uint64_t ahb_stats_now(void);
+void ahb_stats_account(struct ahb *ctx, enum ahb_op op, uint64_t start,
+		       ssize_t bytes);
+void ahb_stats_report(struct ahb *ctx);
+
+static inline uint64_t ahb_stats_start(void)
+{
+	return ahb_stats_enabled ? ahb_stats_now() : 0;
+}
+
 static inline void ahb_init_ops(struct ahb *ctx,
 				const struct bridge_driver *drv,
 				const struct ahb_ops *ops)
 {
 	ctx->drv = drv;
 	ctx->ops = ops;
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	ctx->generation = 0;
 }
 
+/*
+ * Size the next chunk of a bulk transfer of @len bytes at @phys to suit the
+ * bridge: unaligned heads are split off so the remainder is aligned, and
+ * chunks neither exceed the burst size nor cross a window boundary.
+ */
+size_t ahb_plan(const struct ahb *ctx, uint32_t phys, size_t len);
+
+/*
+ * Issue a bulk transfer in ahb_plan() chunks. A short chunk ends the transfer,
+ * returning the bytes moved contiguously from @phys, or -EIO if there were
+ * none.
+ */
+ssize_t ahb_planned_read(struct ahb *ctx, uint32_t phys, void *buf,
+			 size_t len);
+ssize_t ahb_planned_write(struct ahb *ctx, uint32_t phys, const void *buf,
+			  size_t len);
+
 static inline ssize_t ahb_read(struct ahb *ctx, uint32_t phys, void *buf,
 			       size_t len)
 {
-	return ctx->ops->read(ctx, phys, buf, len);
+	uint64_t start = ahb_stats_start();
+	ssize_t rc = ahb_planned_read(ctx, phys, buf, len);
+
+	if (start)
+		ahb_stats_account(ctx, ahb_op_read, start, rc);
+
+	return rc;
 }
 
 static inline ssize_t ahb_write(struct ahb *ctx, uint32_t phys, const void *buf,
 				size_t len)
 {
-	return ctx->ops->write(ctx, phys, buf, len);
+	uint64_t start = ahb_stats_start();
+	ssize_t rc = ahb_planned_write(ctx, phys, buf, len);
+
+	if (start)
+		ahb_stats_account(ctx, ahb_op_write, start, rc);
+
+	return rc;
 }
 
 static inline int ahb_readl(struct ahb *ctx, uint32_t phys, uint32_t *val)
 {
+	uint64_t start = ahb_stats_start();
 	int rc = ctx->ops->readl(ctx, phys, val);
+
+	if (start)
+		ahb_stats_account(ctx, ahb_op_readl, start,
+				  rc ? rc : (ssize_t)sizeof(*val));
+
 	if (!rc) {
 		logt("%s: 0x%08" PRIx32 ": 0x%08" PRIx32 "\n", __func__, phys,
 		     *val);
@@ -68,7 +188,13 @@ static inline int ahb_readl(struct ahb *ctx, uint32_t phys, uint32_t *val)
 
 static inline int ahb_writel(struct ahb *ctx, uint32_t phys, uint32_t val)
 {
+	uint64_t start = ahb_stats_start();
 	int rc = ctx->ops->writel(ctx, phys, val);
+
+	if (start)
+		ahb_stats_account(ctx, ahb_op_writel, start,
+				  rc ? rc : (ssize_t)sizeof(val));
+
 	if (!rc) {
 		logt("%s: 0x%08" PRIx32 ": 0x%08" PRIx32 "\n", __func__, phys,
 		     val);
@@ -77,6 +203,9 @@ static inline int ahb_writel(struct ahb *ctx, uint32_t phys, uint32_t val)
 	return rc;
 }
 
+int ahb_readv(struct ahb *ctx, struct ahb_vec *vec, size_t n);
+int ahb_writev(struct ahb *ctx, const struct ahb_vec *vec, size_t n);
+
 ssize_t ahb_siphon_out(struct ahb *ctx, uint32_t phys, ssize_t len, int outfd);
 ssize_t ahb_siphon_in(struct ahb *ctx, uint32_t phys, ssize_t len, int infd);
 
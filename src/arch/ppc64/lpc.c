@@ -1,20 +1,261 @@
 // SPDX-License-Identifier: Apache-2.0
 /* Copyright 2018-2019 IBM Corp. */
 
+#include "array.h"
+#include "compiler.h"
+#include "log.h"
+#include "lpc.h"
+
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#include "lpc.h"
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
 #define SYSFS_PREFIX "/sys/kernel/debug/powerpc/lpc"
 
-int lpc_init(struct lpc *ctx, const char *space)
+#if HAVE_IO_URING
+/*
+ * Each access through debugfs costs a system call. Queued accesses are instead
+ * submitted as a chain of linked reads and writes, so a whole SuperIO sequence
+ * costs one io_uring_enter() and is still issued in order.
+ */
+struct lpc_debugfs_ring {
+	int fd;
+
+	void *sq_ring;
+	size_t sq_ring_len;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+
+	void *cq_ring;
+	size_t cq_ring_len;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static void lpc_debugfs_ring_destroy(struct lpc_debugfs_ring *ring)
+{
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_len);
+	close(ring->fd);
+	free(ring);
+}
+
+/*
+ * io_uring_setup() arrived in Linux 5.1, but IORING_OP_READ and IORING_OP_WRITE
+ * only in 5.6. In between, every batch would fail with -EINVAL rather than
+ * falling back to pread() and pwrite(). IORING_REGISTER_PROBE is also from
+ * 5.6, so older kernels fail the probe itself.
+ */
+static bool lpc_debugfs_ring_supported(int fd)
+{
+	static const uint8_t required[] = { IORING_OP_READ, IORING_OP_WRITE };
+	struct io_uring_probe *probe;
+	const size_t n_ops = 256;
+	bool supported = true;
+	size_t i;
+
+	probe = calloc(1, sizeof(*probe) + n_ops * sizeof(probe->ops[0]));
+	if (!probe)
+		return false;
+
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+		    n_ops) < 0) {
+		logd("lpc: Failed to probe io_uring operations: %d\n", -errno);
+		free(probe);
+		return false;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(required); i++) {
+		uint8_t op = required[i];
+
+		if (op >= probe->ops_len ||
+		    !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+			supported = false;
+	}
+
+	free(probe);
+
+	return supported;
+}
+
+static struct lpc_debugfs_ring *lpc_debugfs_ring_init(void)
+{
+	struct io_uring_params params;
+	struct lpc_debugfs_ring *ring;
+	void *map;
+	int fd;
+
+	memset(&params, 0, sizeof(params));
+	fd = syscall(__NR_io_uring_setup, LPC_QUEUE_LEN, &params);
+	if (fd < 0) {
+		logd("lpc: io_uring unavailable, issuing queued accesses serially: %d\n",
+		     -errno);
+		return NULL;
+	}
+
+	if (!lpc_debugfs_ring_supported(fd)) {
+		logd("lpc: io_uring can't read or write, issuing queued accesses serially\n");
+		close(fd);
+		return NULL;
+	}
+
+	if (!(ring = calloc(1, sizeof(*ring)))) {
+		close(fd);
+		return NULL;
+	}
+
+	ring->fd = fd;
+
+	ring->sq_ring_len = params.sq_off.array +
+			    params.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_len = params.cq_off.cqes +
+			    params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_len > ring->sq_ring_len)
+			ring->sq_ring_len = ring->cq_ring_len;
+		ring->cq_ring_len = ring->sq_ring_len;
+	}
+
+	map = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (map == MAP_FAILED)
+		goto cleanup_ring;
+	ring->sq_ring = map;
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		map = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (map == MAP_FAILED)
+			goto cleanup_ring;
+		ring->cq_ring = map;
+	}
+
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	map = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (map == MAP_FAILED)
+		goto cleanup_ring;
+	ring->sqes = map;
+
+	ring->sq_head = ring->sq_ring + params.sq_off.head;
+	ring->sq_tail = ring->sq_ring + params.sq_off.tail;
+	ring->sq_mask = ring->sq_ring + params.sq_off.ring_mask;
+	ring->sq_array = ring->sq_ring + params.sq_off.array;
+
+	ring->cq_head = ring->cq_ring + params.cq_off.head;
+	ring->cq_tail = ring->cq_ring + params.cq_off.tail;
+	ring->cq_mask = ring->cq_ring + params.cq_off.ring_mask;
+	ring->cqes = ring->cq_ring + params.cq_off.cqes;
+
+	return ring;
+
+cleanup_ring:
+	logd("lpc: Failed to map io_uring: %d\n", -errno);
+	lpc_debugfs_ring_destroy(ring);
+
+	return NULL;
+}
+
+/* @n must not exceed LPC_QUEUE_LEN, the size of the submission queue */
+static int lpc_debugfs_ring_batch(struct lpc *ctx,
+				  struct lpc_debugfs_ring *ring,
+				  struct lpc_op *ops, size_t n)
+{
+	size_t i, pending, done;
+	unsigned int tail, head;
+	int err = 0;
+	int rc;
+
+	tail = *ring->sq_tail;
+	for (i = 0; i < n; i++) {
+		unsigned int idx = (tail + i) & *ring->sq_mask;
+		struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = ops[i].dst ? IORING_OP_READ : IORING_OP_WRITE;
+		sqe->fd = ctx->fd;
+		sqe->off = ops[i].addr;
+		sqe->addr = (uintptr_t)(ops[i].dst ?: &ops[i].val);
+		sqe->len = 1;
+		sqe->user_data = i;
+		/* Later accesses are cancelled if an earlier one fails */
+		if (i + 1 < n)
+			sqe->flags = IOSQE_IO_LINK;
+
+		ring->sq_array[idx] = idx;
+	}
+	__atomic_store_n(ring->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+	head = *ring->cq_head;
+	for (pending = n, done = 0; done < n;) {
+		rc = syscall(__NR_io_uring_enter, ring->fd, pending, 1,
+			     IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			rc = -errno;
+			if (!pending)
+				return err ?: rc;
+
+			/* Withdraw what wasn't consumed, reap what was */
+			n -= pending;
+			pending = 0;
+			__atomic_store_n(ring->sq_tail, tail + n,
+					 __ATOMIC_RELEASE);
+			err = err ?: rc;
+		} else {
+			pending -= rc;
+		}
+
+		/* Reap every completion so the ring is left empty */
+		while (head != __atomic_load_n(ring->cq_tail,
+					       __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe *cqe;
+
+			cqe = &ring->cqes[head & *ring->cq_mask];
+			if (!err && cqe->res != 1)
+				err = cqe->res < 0 ? cqe->res : -EIO;
+			head++;
+			done++;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return err;
+}
+#endif
+
+static int lpc_debugfs_init(struct lpc *ctx, const char *space,
+			    const char *args __unused)
 {
 	char pathbuf[PATH_MAX];
 	int rc;
@@ -30,15 +271,24 @@ int lpc_init(struct lpc *ctx, const char *space)
 	if (ctx->fd == -1)
 		return -errno;
 
+#if HAVE_IO_URING
+	ctx->priv = lpc_debugfs_ring_init();
+#endif
+
 	return 0;
 }
 
-int lpc_destroy(struct lpc *ctx)
+static int lpc_debugfs_destroy(struct lpc *ctx)
 {
 	int rc;
 
 	assert(ctx);
 
+#if HAVE_IO_URING
+	if (ctx->priv)
+		lpc_debugfs_ring_destroy(ctx->priv);
+#endif
+
 	rc = close(ctx->fd);
 	if (rc == -1)
 		return -errno;
@@ -46,88 +296,64 @@ int lpc_destroy(struct lpc *ctx)
 	return 0;
 }
 
-int lpc_read(struct lpc *ctx, size_t addr, void *val, size_t size)
+/* The address is the file offset, so there's no need to seek separately */
+static int lpc_debugfs_read(struct lpc *ctx, size_t addr, void *val,
+			    size_t size)
 {
-	off_t seek_rc;
 	ssize_t rc;
 
-	seek_rc = lseek(ctx->fd, addr, SEEK_SET);
-	if (seek_rc == (off_t)-1)
-		return -errno;
-
-	rc = read(ctx->fd, val, size);
+	rc = pread(ctx->fd, val, size, addr);
 	if (rc == -1)
 		return -errno;
 
 	return rc;
 }
 
-int lpc_write(struct lpc *ctx, size_t addr, const void *val, size_t size)
+static int lpc_debugfs_write(struct lpc *ctx, size_t addr, const void *val,
+			     size_t size)
 {
-	off_t seek_rc;
 	ssize_t rc;
 
-	seek_rc = lseek(ctx->fd, addr, SEEK_SET);
-	if (seek_rc == (off_t)-1)
-		return -errno;
-
-	rc = write(ctx->fd, val, size);
+	rc = pwrite(ctx->fd, val, size, addr);
 	if (rc == -1)
 		return -errno;
 
 	return rc;
 }
 
-int lpc_readb(struct lpc *ctx, size_t addr, uint8_t *val)
+static int lpc_debugfs_batch(struct lpc *ctx, struct lpc_op *ops, size_t n)
 {
+	size_t i;
 	int rc;
 
-	rc = lpc_read(ctx, addr, val, sizeof(*val));
-
-	return rc < 0 ? rc : 0;
-}
+#if HAVE_IO_URING
+	if (ctx->priv)
+		return lpc_debugfs_ring_batch(ctx, ctx->priv, ops, n);
+#endif
+
+	for (i = 0; i < n; i++) {
+		if (ops[i].dst)
+			rc = lpc_debugfs_read(ctx, ops[i].addr, ops[i].dst, 1);
+		else
+			rc = lpc_debugfs_write(ctx, ops[i].addr, &ops[i].val,
+					       1);
+		if (rc < 0)
+			return rc;
+		if (rc != 1)
+			return -EIO;
+	}
 
-int lpc_writeb(struct lpc *ctx, size_t addr, uint8_t val)
-{
-	int rc;
-
-	rc = lpc_write(ctx, addr, &val, sizeof(val));
-
-	return rc < 0 ? rc : 0;
-}
-
-int lpc_readw(struct lpc *ctx, size_t addr, uint16_t *val)
-{
-	int rc;
-
-	rc = lpc_read(ctx, addr, (unsigned char *)val, sizeof(*val));
-
-	return rc < 0 ? rc : 0;
-}
-
-int lpc_writew(struct lpc *ctx, size_t addr, uint16_t val)
-{
-	int rc;
-
-	rc = lpc_write(ctx, addr, (const unsigned char *)&val, sizeof(val));
-
-	return rc < 0 ? rc : 0;
-}
-
-int lpc_readl(struct lpc *ctx, size_t addr, uint32_t *val)
-{
-	int rc;
-
-	rc = lpc_read(ctx, addr, (unsigned char *)val, sizeof(*val));
-
-	return rc < 0 ? rc : 0;
+	return 0;
 }
 
-int lpc_writel(struct lpc *ctx, size_t addr, uint32_t val)
-{
-	int rc;
-
-	rc = lpc_write(ctx, addr, (const unsigned char *)&val, sizeof(val));
-
-	return rc < 0 ? rc : 0;
-}
+/* The LPC spaces as exposed by skiboot through debugfs */
+static const struct lpc_backend lpc_debugfs_backend = {
+	.name = "debugfs",
+	.preferred = true,
+	.init = lpc_debugfs_init,
+	.destroy = lpc_debugfs_destroy,
+	.read = lpc_debugfs_read,
+	.write = lpc_debugfs_write,
+	.batch = lpc_debugfs_batch,
+};
+REGISTER_LPC_BACKEND(lpc_debugfs_backend);
@@ -2,12 +2,22 @@
 /* Copyright 2014-2016 IBM Corp. */
 
 #include "compiler.h"
+#include "log.h"
 #include "lpc.h"
+#include "mmio.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/io.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
 #if !defined(__GLIBC__)
 static __inline unsigned char inb_p(unsigned short int __port)
@@ -62,78 +72,451 @@ static __inline void outl_p(unsigned int __value, unsigned short int __port)
 }
 #endif
 
-int lpc_init(struct lpc *ctx __unused, const char *space)
+/*
+ * How to pace port accesses. Legacy devices may need time to settle between
+ * cycles, traditionally provided by a dummy write to port 0x80.
+ */
+enum lpc_port_delay {
+	lpc_delay_port80,
+	lpc_delay_none,
+	lpc_delay_spin,
+};
+
+#define LPC_PORTS (1 << 16)
+
+struct lpc_port {
+	enum lpc_port_delay delay;
+	unsigned long spins;
+
+	/* ioperm() grants, if not using iopl() */
+	bool scoped;
+	uint8_t granted[LPC_PORTS / 8];
+};
+
+static unsigned long lpc_spins_per_us;
+
+static uint64_t lpc_now_ns(void)
 {
-	int rc;
+	struct timespec ts;
 
-	if (strcmp(space, "io"))
-		return -ENOTSUP;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	/* YOLO */
-	rc = iopl(3);
-	if (rc < 0) {
-		perror("iopl");
-		return rc;
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void lpc_spin(unsigned long spins)
+{
+	volatile unsigned long i;
+
+	for (i = 0; i < spins; i++)
+		;
+}
+
+/* Calibrate the spin loop against the clock once per process */
+static unsigned long lpc_calibrate(void)
+{
+	const unsigned long spins = 1000000;
+	uint64_t start, elapsed;
+
+	if (lpc_spins_per_us)
+		return lpc_spins_per_us;
+
+	start = lpc_now_ns();
+	lpc_spin(spins);
+	elapsed = lpc_now_ns() - start;
+
+	lpc_spins_per_us = elapsed ? (spins * 1000) / elapsed : spins;
+	if (!lpc_spins_per_us)
+		lpc_spins_per_us = 1;
+
+	logd("lpc: Calibrated %lu spins per microsecond\n", lpc_spins_per_us);
+
+	return lpc_spins_per_us;
+}
+
+/* The size of the window opened by fw=PHYS, e.g. Intel's LPC LGMR */
+#define LPC_FW_DEFAULT_LEN (64 << 10)
+
+struct lpc_port_opts {
+	enum lpc_port_delay delay;
+	unsigned long delay_ns;
+
+	/* Where the host decodes LPC memory cycles, if anywhere */
+	uint64_t fw_base;
+	size_t fw_len;
+};
+
+static int lpc_port_parse_delay(struct lpc_port_opts *opts, const char *arg)
+{
+	char *end;
+
+	if (!strcmp(arg, "port80")) {
+		opts->delay = lpc_delay_port80;
+		return 0;
+	}
+
+	if (!strcmp(arg, "none")) {
+		opts->delay = lpc_delay_none;
+		return 0;
+	}
+
+	errno = 0;
+	opts->delay_ns = strtoul(arg, &end, 0);
+	if (errno || *end || end == arg) {
+		loge("lpc: Invalid port delay '%s'\n", arg);
+		return -EINVAL;
 	}
 
+	opts->delay = lpc_delay_spin;
+
 	return 0;
 }
 
-int lpc_destroy(struct lpc *ctx __unused)
+/* PHYS[+LEN] */
+static int lpc_port_parse_fw(struct lpc_port_opts *opts, const char *arg)
 {
+	unsigned long long base, len = LPC_FW_DEFAULT_LEN;
+	char *end;
+
+	errno = 0;
+	base = strtoull(arg, &end, 0);
+	if (!errno && *end == '+')
+		len = strtoull(end + 1, &end, 0);
+
+	if (errno || *end || end == arg || !base || !len || len > SIZE_MAX) {
+		loge("lpc: Invalid firmware window '%s'\n", arg);
+		return -EINVAL;
+	}
+
+	/* The host forwards the physical address as the LPC address */
+	if (base + len < base || base + len > (1ULL << 32)) {
+		loge("lpc: Firmware window '%s' is beyond the LPC address space\n",
+		     arg);
+		return -EINVAL;
+	}
+
+	opts->fw_base = base;
+	opts->fw_len = len;
+
 	return 0;
 }
 
-int lpc_readb(struct lpc *ctx __unused, size_t addr, uint8_t *val)
+/* [delay=port80|none|NS][,fw=PHYS[+LEN]] */
+static int lpc_port_parse(struct lpc_port_opts *opts, const char *args)
 {
-	*val = inb_p(addr);
+	char *dup, *opt, *save;
+	int rc = 0;
 
-	return 0;
+	opts->delay = lpc_delay_port80;
+	opts->delay_ns = 0;
+	opts->fw_base = 0;
+	opts->fw_len = 0;
+
+	if (!args || !*args)
+		return 0;
+
+	if (!(dup = strdup(args)))
+		return -ENOMEM;
+
+	for (opt = strtok_r(dup, ",", &save); opt && !rc;
+	     opt = strtok_r(NULL, ",", &save)) {
+		if (!strncmp(opt, "delay=", strlen("delay="))) {
+			rc = lpc_port_parse_delay(opts, opt + strlen("delay="));
+		} else if (!strncmp(opt, "fw=", strlen("fw="))) {
+			rc = lpc_port_parse_fw(opts, opt + strlen("fw="));
+		} else {
+			loge("lpc: Unrecognised port option '%s'\n", opt);
+			rc = -EINVAL;
+		}
+	}
+
+	free(dup);
+
+	return rc;
 }
 
-int lpc_writeb(struct lpc *ctx __unused, size_t addr, uint8_t val)
+/*
+ * Port I/O only reaches the I/O space. Memory and firmware cycles are issued
+ * by the chipset for accesses to the physical ranges it decodes to LPC, so
+ * reach those through /dev/mem.
+ */
+struct lpc_fw {
+	void *map;
+	size_t map_len;
+	volatile uint8_t *base;
+};
+
+static int lpc_fw_destroy(struct lpc *ctx)
 {
-	outb_p(val, addr);
+	struct lpc_fw *fw = ctx->priv;
+	int rc;
 
-	return 0;
+	munmap(fw->map, fw->map_len);
+	free(fw);
+
+	rc = close(ctx->fd);
+
+	return rc ? -errno : 0;
 }
 
-int lpc_readw(struct lpc *ctx __unused, size_t addr, uint16_t *val)
+static int lpc_fw_read(struct lpc *ctx, size_t addr, void *val, size_t size)
 {
-	*val = inw_p(addr);
+	struct lpc_fw *fw = ctx->priv;
 
-	return 0;
+	if (addr > ctx->size || size > ctx->size - addr)
+		return -EINVAL;
+
+	mmio_read(val, fw->base + addr, size, MMIO_WIDTH_DEFAULT);
+
+	return size;
 }
 
-int lpc_writew(struct lpc *ctx __unused, size_t addr, uint16_t val)
+static int lpc_fw_write(struct lpc *ctx, size_t addr, const void *val,
+			size_t size)
 {
-	outw_p(val, addr);
+	struct lpc_fw *fw = ctx->priv;
+
+	if (addr > ctx->size || size > ctx->size - addr)
+		return -EINVAL;
+
+	mmio_write(fw->base + addr, val, size, MMIO_WIDTH_DEFAULT);
+
+	return size;
+}
+
+/* Not registered: the port backends hand their fw space over to it */
+static const struct lpc_backend lpc_fw_backend = {
+	.name = "devmem",
+	.destroy = lpc_fw_destroy,
+	.read = lpc_fw_read,
+	.write = lpc_fw_write,
+};
+
+static int lpc_fw_init(struct lpc *ctx, const struct lpc_port_opts *opts)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	struct lpc_fw *fw;
+	off_t offset;
+	int rc;
+
+	if (!opts->fw_base) {
+		logd("lpc: No firmware window configured, see fw=PHYS\n");
+		return -ENOTSUP;
+	}
+
+	if (!(fw = malloc(sizeof(*fw))))
+		return -ENOMEM;
+
+	ctx->fd = open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC);
+	if (ctx->fd < 0) {
+		rc = -errno;
+		loge("lpc: Failed to open /dev/mem: %d\n", rc);
+		goto cleanup_fw;
+	}
+
+	offset = opts->fw_base & ~(uint64_t)(page - 1);
+	fw->map_len = opts->fw_base - offset + opts->fw_len;
+	fw->map = mmap(NULL, fw->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		       ctx->fd, offset);
+	if (fw->map == MAP_FAILED) {
+		rc = -errno;
+		loge("lpc: Failed to map firmware window at 0x%" PRIx64
+		     ": %d\n",
+		     opts->fw_base, rc);
+		goto cleanup_fd;
+	}
+
+	fw->base = (uint8_t *)fw->map + (opts->fw_base - offset);
+
+	logd("lpc: Mapped %zu byte firmware window at 0x%" PRIx64 "\n",
+	     opts->fw_len, opts->fw_base);
+
+	ctx->backend = &lpc_fw_backend;
+	ctx->priv = fw;
+	ctx->size = opts->fw_len;
+	ctx->base = opts->fw_base;
 
 	return 0;
+
+cleanup_fd:
+	close(ctx->fd);
+	ctx->fd = -1;
+
+cleanup_fw:
+	free(fw);
+
+	return rc;
 }
 
-int lpc_readl(struct lpc *ctx __unused, size_t addr, uint32_t *val)
+/* Request access to just the ports touched, as they're touched */
+static int lpc_port_access(struct lpc_port *port, size_t addr, size_t width)
 {
-	*val = inl_p(addr);
+	size_t i;
+
+	if (addr + width > LPC_PORTS)
+		return -EINVAL;
+
+	if (!port->scoped)
+		return 0;
+
+	for (i = addr; i < addr + width; i++) {
+		if (port->granted[i / 8] & (1 << (i % 8)))
+			continue;
+
+		if (ioperm(i, 1, 1) < 0) {
+			int rc = -errno;
+
+			loge("lpc: Failed to gain access to port 0x%zx: %d\n",
+			     i, rc);
+			return rc;
+		}
+
+		port->granted[i / 8] |= 1 << (i % 8);
+	}
 
 	return 0;
 }
 
-int lpc_writel(struct lpc *ctx __unused, size_t addr, uint32_t val)
+static int __lpc_port_init(struct lpc *ctx, const char *space,
+			   const char *args, bool scoped)
 {
-	outl_p(val, addr);
+	struct lpc_port_opts opts;
+	struct lpc_port *port;
+	int rc;
+
+	if ((rc = lpc_port_parse(&opts, args)) < 0)
+		return rc;
+
+	if (!strcmp(space, "fw"))
+		return lpc_fw_init(ctx, &opts);
+
+	if (strcmp(space, "io"))
+		return -ENOTSUP;
+
+	if (!(port = calloc(1, sizeof(*port))))
+		return -ENOMEM;
+
+	port->delay = opts.delay;
+	if (opts.delay == lpc_delay_spin)
+		port->spins = (opts.delay_ns * lpc_calibrate() + 999) / 1000;
+	port->scoped = scoped;
+
+	/* YOLO */
+	if (!scoped && iopl(3) < 0) {
+		rc = -errno;
+		perror("iopl");
+		goto cleanup_port;
+	}
+
+	/* The *_p() accessors pace themselves with a write to port 0x80 */
+	if (port->delay == lpc_delay_port80 &&
+	    (rc = lpc_port_access(port, 0x80, 1)) < 0)
+		goto cleanup_port;
+
+	ctx->priv = port;
 
 	return 0;
+
+cleanup_port:
+	free(port);
+
+	return rc;
 }
 
-int lpc_read(struct lpc *ctx __unused, size_t addr __unused, void *val __unused,
-	     size_t size __unused)
+static int lpc_port_init(struct lpc *ctx, const char *space, const char *args)
 {
-	return -ENOTSUP;
+	return __lpc_port_init(ctx, space, args, false);
 }
 
-int lpc_write(struct lpc *ctx __unused, size_t addr __unused,
-	      const void *val __unused, size_t size __unused)
+static int lpc_ioperm_init(struct lpc *ctx, const char *space,
+			   const char *args)
 {
-	return -ENOTSUP;
+	return __lpc_port_init(ctx, space, args, true);
+}
+
+/*
+ * Grants are per-thread rather than per-context, and other contexts may share
+ * the ports (e.g. the SuperIO), so leave them in place until we exit.
+ */
+static int lpc_port_destroy(struct lpc *ctx)
+{
+	free(ctx->priv);
+
+	return 0;
 }
+
+#define LPC_PORT_IN(_name, _type, _in, _in_p)                                 \
+	static int lpc_port_##_name(struct lpc *ctx, size_t addr, _type *val) \
+	{                                                                      \
+		struct lpc_port *port = ctx->priv;                             \
+		int rc;                                                        \
+                                                                               \
+		if ((rc = lpc_port_access(port, addr, sizeof(*val))))          \
+			return rc;                                             \
+                                                                               \
+		if (port->delay == lpc_delay_port80) {                         \
+			*val = _in_p(addr);                                    \
+			return 0;                                              \
+		}                                                              \
+                                                                               \
+		*val = _in(addr);                                              \
+		lpc_spin(port->spins);                                         \
+                                                                               \
+		return 0;                                                      \
+	}
+
+#define LPC_PORT_OUT(_name, _type, _out, _out_p)                              \
+	static int lpc_port_##_name(struct lpc *ctx, size_t addr, _type val)  \
+	{                                                                      \
+		struct lpc_port *port = ctx->priv;                             \
+		int rc;                                                        \
+                                                                               \
+		if ((rc = lpc_port_access(port, addr, sizeof(val))))           \
+			return rc;                                             \
+                                                                               \
+		if (port->delay == lpc_delay_port80) {                         \
+			_out_p(val, addr);                                     \
+			return 0;                                              \
+		}                                                              \
+                                                                               \
+		_out(val, addr);                                               \
+		lpc_spin(port->spins);                                         \
+                                                                               \
+		return 0;                                                      \
+	}
+
+LPC_PORT_IN(readb, uint8_t, inb, inb_p)
+LPC_PORT_OUT(writeb, uint8_t, outb, outb_p)
+LPC_PORT_IN(readw, uint16_t, inw, inw_p)
+LPC_PORT_OUT(writew, uint16_t, outw, outw_p)
+LPC_PORT_IN(readl, uint32_t, inl, inl_p)
+LPC_PORT_OUT(writel, uint32_t, outl, outl_p)
+
+/* Direct port I/O after raising the I/O privilege level */
+static const struct lpc_backend lpc_port_backend = {
+	.name = "port",
+	.preferred = true,
+	.init = lpc_port_init,
+	.destroy = lpc_port_destroy,
+	.readb = lpc_port_readb,
+	.writeb = lpc_port_writeb,
+	.readw = lpc_port_readw,
+	.writew = lpc_port_writew,
+	.readl = lpc_port_readl,
+	.writel = lpc_port_writel,
+};
+REGISTER_LPC_BACKEND(lpc_port_backend);
+
+/* Direct port I/O, but only to the ports we actually use */
+static const struct lpc_backend lpc_ioperm_backend = {
+	.name = "ioperm",
+	.init = lpc_ioperm_init,
+	.destroy = lpc_port_destroy,
+	.readb = lpc_port_readb,
+	.writeb = lpc_port_writeb,
+	.readw = lpc_port_readw,
+	.writew = lpc_port_writew,
+	.readl = lpc_port_readl,
+	.writel = lpc_port_writel,
+};
+REGISTER_LPC_BACKEND(lpc_ioperm_backend);
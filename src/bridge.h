@@ -11,6 +11,28 @@
 
 #include "ccan/autodata/autodata.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * How to drive a bridge efficiently, consumed by ahb_plan(). Zero means
+ * unconstrained.
+ */
+struct bridge_caps {
+	/* Natural access width in bytes */
+	uint32_t width;
+	/* Alignment of phys that bulk transfers run fastest from */
+	uint32_t align;
+	/* Largest transfer worth issuing as a single operation */
+	size_t burst;
+	/* Transfers that stay inside one naturally aligned window avoid a remap */
+	size_t window;
+	/* Rough cost of moving 1KiB, in nanoseconds */
+	uint64_t cost;
+	/* Widest access safe through its MMIO window, see mmio_width() */
+	uint32_t mmio_width;
+};
+
 struct bridge_driver {
 	const char *name;
 	struct ahb *(*probe)(struct connection_args *connection);
@@ -27,11 +49,40 @@ struct bridge_driver {
 	 */
 	bool local;
 
+	/*
+	 * Whether the driver uses the host's LPC I/O ports (i.e. ilpc). These
+	 * share the SuperIO and I/O privileges are per-thread, so such drivers
+	 * are probed in turn on the calling thread rather than in the
+	 * background.
+	 */
+	bool port_io;
+
+	/*
+	 * Whether the driver is only used when selected with 'via', e.g. as it
+	 * may share hardware state with another driver (i.e. p2a-bmc)
+	 */
+	bool explicit_only;
+
+	/* How long a background probe may take, or 0 for the default */
+	unsigned int probe_timeout_ms;
+
 	/* Set if this driver has been explicitly disabled */
 	bool disabled;
+
+	struct bridge_caps caps;
 };
 
 AUTODATA_TYPE(bridge_drivers, struct bridge_driver);
 #define REGISTER_BRIDGE_DRIVER(bd) AUTODATA_SYM(bridge_drivers, bd)
 
+/*
+ * A background probe is abandoned when it passes its deadline or a fast bridge
+ * answers first. Drivers check bridge_probe_cancelled() between steps, and
+ * wait on bridge_probe_cancel_fd() alongside the device where they may block,
+ * so they stop promptly. Outside a background probe the fd is -1 and the probe
+ * is never cancelled. The fd is only valid until probe() returns.
+ */
+bool bridge_probe_cancelled(void);
+int bridge_probe_cancel_fd(void);
+
 #endif
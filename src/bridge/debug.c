@@ -7,6 +7,7 @@
 #include "console.h"
 #include "connection.h"
 #include "debug.h"
+#include "debug_d.h"
 #include "log.h"
 #include "prompt.h"
 #include "ts16.h"
@@ -118,48 +119,6 @@ int debug_probe(struct debug *ctx)
 	return debug_exit(ctx);
 }
 
-static ssize_t debug_parse_d(char *line, char *buf)
-{
-	char *eoa, *words, *token, *stream;
-	char *saveptr;
-	char *cursor;
-	ssize_t rc;
-
-	/* Strip leading address */
-	eoa = strchr(line, ':');
-	if (!eoa)
-		return -EBADE;
-
-	/* Extract 4-byte values */
-	words = eoa + 1;
-	cursor = buf;
-	stream = strdup(words);
-	while ((token = strtok_r(words, " ", &saveptr))) {
-		rc = sscanf(token, "%02hhx%02hhx%02hhx%02hhx", &cursor[3],
-			    &cursor[2], &cursor[1], &cursor[0]);
-		if (rc < 0) {
-			rc = -errno;
-			goto done;
-		}
-
-		if (rc < 4) {
-			loge("Wanted 4 but extracted %zd bytes from token '%s' in words '%s' from line '%s'\n",
-			     rc, token, words, line);
-			rc = -EBADE;
-			goto done;
-		}
-
-		cursor += rc;
-		words = NULL;
-	}
-
-	rc = cursor - buf;
-
-done:
-	free(stream);
-	return rc;
-}
-
 static int debug_read_fixed(struct debug *ctx, char mode, uint32_t phys,
 			    uint32_t *val)
 {
@@ -205,10 +164,10 @@ static int debug_read_fixed(struct debug *ctx, char mode, uint32_t phys,
 
 ssize_t debug_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
 {
-	char line[2 *
-		  sizeof("20002ba0:31e01002 20433002 30813003 e1a06002\r\n")];
 	struct debug *ctx = to_debug(ahb);
 	size_t remaining = len;
+	struct debug_d parser;
+	const char *data;
 	size_t ingress;
 	char *command;
 	char *cursor;
@@ -237,9 +196,6 @@ ssize_t debug_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
 
 	cursor = buf;
 	do {
-		size_t consumed;
-		int found;
-
 retry:
 		ingress = remaining > DEBUG_D_MAX_LEN ? DEBUG_D_MAX_LEN :
 							remaining;
@@ -253,44 +209,38 @@ retry:
 		if (rc < 0)
 			return -1;
 
-		/* Eat the echoed command */
-		do {
-			found = prompt_gets(&ctx->prompt, line, sizeof(line));
-			if (found < 0)
-				return -1;
-		} while (!strcmp("$ \n",
-				 line)); /* Deal any prompt from a prior run */
-
-		consumed = 0;
-		do {
-			found = prompt_gets(&ctx->prompt, line, sizeof(line));
-			if (found < 0)
+		debug_d_init(&parser, cursor, ingress);
+		while (parser.remaining) {
+			rc = prompt_peek(&ctx->prompt, &data);
+			if (rc < 0)
 				return -1;
 
-			rc = debug_parse_d(line, cursor);
+			rc = debug_d_feed(&parser, data, rc);
 			if (rc < 0) {
+				loge("Failed to parse dump at 0x%" PRIx32 "\n",
+				     phys + (uint32_t)(ingress -
+						       parser.remaining));
 				rc = prompt_run(&ctx->prompt, "");
 				if (rc < 0)
 					return -1;
 				rc = prompt_expect(&ctx->prompt, "$ ");
 				if (rc < 0)
 					return -1;
-				loge("Failed to parse line '%s'\n", line);
 				loge("Retrying from address 0x%" PRIx32 "\n",
 				     phys);
 				goto retry;
 			}
 
-			cursor += rc;
-			consumed += rc;
-		} while (consumed < ingress);
+			prompt_consume(&ctx->prompt, rc);
+		}
 
-		/*
-		 * Normally we would prompt_expect() here, but prompt_gets() has likely
-		 * swallowed the prompt, so we'll YOLO and just assume it's done.
-		 */
+		/* The prompt is still buffered, so we can wait for it */
+		rc = prompt_expect(&ctx->prompt, "$ ");
+		if (rc < 0)
+			return -1;
 
 		phys += ingress;
+		cursor += ingress;
 		remaining -= ingress;
 	} while (remaining);
 
@@ -495,6 +445,14 @@ static struct bridge_driver debug_driver = {
 	.release = debug_driver_release,
 	.reinit = debug_driver_reinit,
 	.path_required = true,
+	/* Entering the debug shell involves a 1200 baud login and some naps */
+	.probe_timeout_ms = 30 * 1000,
+	.caps = {
+		.width = 4,
+		.align = 4,
+		.burst = DEBUG_D_MAX_LEN,
+		.cost = DEBUG_KIB_NS,
+	},
 };
 REGISTER_BRIDGE_DRIVER(debug_driver);
 
@@ -580,11 +538,23 @@ static struct ahb *debug_driver_probe(struct connection_args *connection)
 		}
 	}
 
+	/* Stop between commands, or while waiting on a silent UART */
+	prompt_set_cancel(&ctx->prompt, bridge_probe_cancel_fd());
+
+	if (bridge_probe_cancelled()) {
+		rc = -ECANCELED;
+		goto destroy_ctx;
+	}
+
 	if ((rc = debug_enter(ctx)) < 0) {
-		loge("Failed to enter debug UART context: %d\n", rc);
+		if (rc != -ECANCELED)
+			loge("Failed to enter debug UART context: %d\n", rc);
 		goto destroy_ctx;
 	}
 
+	/* The fd goes away with the probe, destroy() must run to completion */
+	prompt_set_cancel(&ctx->prompt, -1);
+
 	return debug_as_ahb(ctx);
 
 destroy_ctx:
@@ -13,6 +13,9 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+/* Rough cost of hexdumping 1KiB over a 115200 baud UART, in nanoseconds */
+#define DEBUG_KIB_NS (300ULL * 1000 * 1000)
+
 struct debug {
 	struct ahb ahb;
 	struct console *console;
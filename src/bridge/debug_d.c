@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2018,2019 IBM Corp.
+
+#include "debug_d.h"
+
+#include <errno.h>
+#include <stdint.h>
+
+/* A hex digit's value, with bit 4 set to mark it as a digit at all */
+static const uint8_t debug_hex[256] = {
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+	['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+	['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d, ['e'] = 0x1e,
+	['f'] = 0x1f, ['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d,
+	['E'] = 0x1e, ['F'] = 0x1f,
+};
+
+void debug_d_init(struct debug_d *ctx, void *buf, size_t len)
+{
+	ctx->state = debug_d_addr;
+	ctx->digits = 0;
+	ctx->word = 0;
+	ctx->cursor = buf;
+	ctx->remaining = len;
+}
+
+static void debug_d_emit(struct debug_d *ctx)
+{
+	size_t n = ctx->remaining < 4 ? ctx->remaining : 4;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		*ctx->cursor++ = ctx->word >> (8 * i);
+
+	ctx->remaining -= n;
+}
+
+ssize_t debug_d_feed(struct debug_d *ctx, const char *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && ctx->remaining; i++) {
+		uint8_t c = data[i];
+		uint8_t hex = debug_hex[c];
+
+		switch (ctx->state) {
+		case debug_d_addr:
+			if (hex && ctx->digits < 8) {
+				ctx->digits++;
+			} else if (c == ':' && ctx->digits) {
+				ctx->state = debug_d_data;
+				ctx->digits = 0;
+				ctx->word = 0;
+			} else if (c == '\n') {
+				ctx->digits = 0;
+			} else {
+				ctx->state = debug_d_skip;
+			}
+			break;
+		case debug_d_skip:
+			if (c == '\n') {
+				ctx->state = debug_d_addr;
+				ctx->digits = 0;
+			}
+			break;
+		case debug_d_data:
+			if (hex) {
+				if (ctx->digits == 8)
+					return -EBADE;
+
+				ctx->word = (ctx->word << 4) | (hex & 0xf);
+				if (++ctx->digits == 8)
+					debug_d_emit(ctx);
+			} else if (c == ' ' || c == '\r' || c == '\n') {
+				if (ctx->digits && ctx->digits != 8)
+					return -EBADE;
+
+				ctx->digits = 0;
+				ctx->word = 0;
+				if (c == '\n')
+					ctx->state = debug_d_addr;
+			} else {
+				return -EBADE;
+			}
+			break;
+		}
+	}
+
+	return i;
+}
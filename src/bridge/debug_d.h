@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/* Copyright (C) 2018,2019 IBM Corp. */
+
+#ifndef _BRIDGE_DEBUG_D_H
+#define _BRIDGE_DEBUG_D_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * The 'd' command prints lines of the form
+ *
+ *     20002ba0:31e01002 20433002 30813003 e1a06002
+ *
+ * Lines that don't start with an address and a colon, such as the echoed
+ * command or a stray prompt, are skipped. Each word is decoded straight into
+ * the destination as it arrives, so lines may be split across reads.
+ */
+enum debug_d_state {
+	debug_d_addr,
+	debug_d_data,
+	debug_d_skip,
+};
+
+struct debug_d {
+	enum debug_d_state state;
+	unsigned int digits;
+	uint32_t word;
+	uint8_t *cursor;
+	size_t remaining;
+};
+
+void debug_d_init(struct debug_d *ctx, void *buf, size_t len);
+
+/*
+ * Returns the number of bytes consumed, stopping once the buffer is full, or
+ * -EBADE if the dump is malformed
+ */
+ssize_t debug_d_feed(struct debug_d *ctx, const char *data, size_t len);
+
+#endif
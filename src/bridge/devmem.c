@@ -1,7 +1,6 @@
 // SPDX-License-Identifier: Apache-2.0
 // Copyright (C) 2018,2019 IBM Corp.
 
-#include <assert.h>
 #include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -29,6 +28,11 @@
 #define AST_SOC_IO     0x1e600000
 #define AST_SOC_IO_LEN 0x00200000
 
+#define AST_G4_DRAM	0x40000000
+#define AST_G4_DRAM_END 0x60000000
+#define AST_G5_DRAM	0x80000000
+#define AST_G5_DRAM_END 0x100000000ULL
+
 #define to_devmem(ahb) container_of(ahb, struct devmem, ahb)
 
 int devmem_probe(struct devmem *ctx)
@@ -42,58 +46,114 @@ int devmem_probe(struct devmem *ctx)
 #endif
 
 	rc = rev_probe(devmem_as_ahb(ctx));
+	if (rc < 0)
+		return rc;
+
+	if (rev_generation(rc) == ast_g4) {
+		ctx->dram_start = AST_G4_DRAM;
+		ctx->dram_end = AST_G4_DRAM_END;
+	} else {
+		ctx->dram_start = AST_G5_DRAM;
+		ctx->dram_end = AST_G5_DRAM_END;
+	}
+
+	return 1;
+}
+
+static int devmem_unmap_win(struct devmem_win *win)
+{
+	int rc;
 
-	return rc < 0 ? rc : 1;
+	if (!win->base)
+		return 0;
+
+	rc = munmap(win->base, win->len);
+	win->base = NULL;
+	win->len = 0;
+
+	return rc < 0 ? -errno : 0;
 }
 
-static int64_t devmem_setup_win(struct devmem *ctx, uint32_t phys, size_t len)
+/*
+ * Registers and bulk data are usually far apart, so keep a handful of
+ * mappings around rather than remapping every time the two alternate. Map
+ * whole DEVMEM_WIN_LEN blocks where we can so neighbouring accesses hit, and
+ * size the mapping to the access for bulk transfers that are larger still.
+ */
+static void *devmem_setup_win(struct devmem *ctx, uint32_t phys, size_t len)
 {
-	uint32_t aligned = phys & ~(ctx->pgsize - 1);
-	uint32_t offset = phys & (ctx->pgsize - 1);
+	struct devmem_win *win, *victim = NULL;
+	uint64_t aligned, end;
 	int rc;
 
-	if (ctx->win && !(ctx->phys == aligned && ctx->len >= offset + len)) {
-		rc = munmap(ctx->win, ctx->len);
-		if (rc < 0)
-			goto cleanup;
+	/* The SoC IO block is mapped for the life of the bridge */
+	if (phys >= AST_SOC_IO &&
+	    (uint64_t)phys + len <= (uint64_t)AST_SOC_IO + AST_SOC_IO_LEN)
+		return ctx->io + (phys - AST_SOC_IO);
+
+	ctx->clock++;
 
-		ctx->win = NULL;
+	for (win = &ctx->wins[0]; win < &ctx->wins[DEVMEM_WINS]; win++) {
+		if (win->base && win->phys <= phys &&
+		    (uint64_t)phys + len <= win->phys + win->len) {
+			win->used = ctx->clock;
+			return win->base + (phys - win->phys);
+		}
+
+		if (!victim || !win->base ||
+		    (victim->base && win->used < victim->used))
+			victim = win;
 	}
 
-	if (!ctx->win) {
-		ctx->win = mmap(NULL, offset + len, PROT_READ | PROT_WRITE,
-				MAP_SHARED, ctx->fd, aligned);
-		if (ctx->win == MAP_FAILED)
-			goto cleanup;
+	if ((rc = devmem_unmap_win(victim)) < 0) {
+		errno = -rc;
+		return NULL;
+	}
 
-		ctx->phys = aligned;
-		ctx->len = offset + len;
+	/* Populate up front so streaming through the window doesn't fault */
+	aligned = phys & ~(DEVMEM_WIN_LEN - 1);
+	end = ((uint64_t)phys + len + DEVMEM_WIN_LEN - 1) &
+	      ~(uint64_t)(DEVMEM_WIN_LEN - 1);
+	victim->base = mmap(NULL, end - aligned, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ctx->fd, aligned);
+
+	/* The neighbourhood may not be mappable, so fall back to the pages */
+	if (victim->base == MAP_FAILED) {
+		aligned = phys & ~(ctx->pgsize - 1);
+		end = ((uint64_t)phys + len + ctx->pgsize - 1) &
+		      ~(uint64_t)(ctx->pgsize - 1);
+		victim->base = mmap(NULL, end - aligned, PROT_READ | PROT_WRITE,
+				    MAP_SHARED | MAP_POPULATE, ctx->fd,
+				    aligned);
 	}
 
-	return offset;
+	if (victim->base == MAP_FAILED) {
+		victim->base = NULL;
+		return NULL;
+	}
 
-cleanup:
-	ctx->win = NULL;
-	ctx->phys = 0;
-	ctx->len = 0;
+	victim->phys = aligned;
+	victim->len = end - aligned;
+	victim->used = ctx->clock;
+	ctx->maps++;
 
-	return -errno;
+	return victim->base + (phys - aligned);
 }
 
 ssize_t devmem_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
 {
 	struct devmem *ctx = to_devmem(ahb);
-	int64_t woff;
+	void *win;
 
 	if (len > SSIZE_MAX) {
 		return -1;
 	}
 
-	woff = devmem_setup_win(ctx, phys, len);
-	if (woff < 0)
+	win = devmem_setup_win(ctx, phys, len);
+	if (!win)
 		return -1;
 
-	mmio_memcpy(buf, ctx->win + woff, len);
+	mmio_read(buf, win, len, ctx->width);
 
 	return len;
 }
@@ -102,44 +162,49 @@ ssize_t devmem_write(struct ahb *ahb, uint32_t phys, const void *buf,
 		     size_t len)
 {
 	struct devmem *ctx = to_devmem(ahb);
-	int64_t woff;
+	void *win;
 
 	if (len > SSIZE_MAX) {
 		return -1;
 	}
 
-	woff = devmem_setup_win(ctx, phys, len);
-	if (woff < 0)
+	win = devmem_setup_win(ctx, phys, len);
+	if (!win)
 		return -1;
 
-	mmio_memcpy(ctx->win + woff, buf, len);
+	mmio_write(win, buf, len, ctx->width);
 
 	return len;
 }
 
+/*
+ * The kernel copies out of the mapping with whatever accesses suit it rather
+ * than ctx->width, which is only safe for DRAM. Registers and the flash
+ * windows take the mmio_read() path.
+ */
+void *devmem_map(struct ahb *ahb, uint32_t phys, size_t *len)
+{
+	struct devmem *ctx = to_devmem(ahb);
+
+	if (phys < ctx->dram_start || (uint64_t)phys + *len > ctx->dram_end)
+		return NULL;
+
+	return devmem_setup_win(ctx, phys, *len);
+}
+
 int devmem_readl(struct ahb *ahb, uint32_t phys, uint32_t *val)
 {
 	struct devmem *ctx = to_devmem(ahb);
-	uint32_t container;
+	void *win;
 
 	if (phys & 0x3)
 		return -EINVAL;
 
-	if (phys >= AST_SOC_IO && phys < (AST_SOC_IO + AST_SOC_IO_LEN)) {
-		off_t offset = phys - AST_SOC_IO;
-		container =
-			*((volatile uint32_t *)(((char *)ctx->io) + offset));
-	} else {
-		int64_t woff;
-
-		woff = devmem_setup_win(ctx, phys, sizeof(*val));
-		if (woff < 0)
-			return woff;
-
-		container = *((volatile uint32_t *)(((char *)ctx->win) + woff));
-	}
+	win = devmem_setup_win(ctx, phys, sizeof(*val));
+	if (!win)
+		return -errno;
 
-	*val = le32toh(container);
+	*val = le32toh(*(volatile uint32_t *)win);
 
 	return 0;
 }
@@ -147,24 +212,16 @@ int devmem_readl(struct ahb *ahb, uint32_t phys, uint32_t *val)
 int devmem_writel(struct ahb *ahb, uint32_t phys, uint32_t val)
 {
 	struct devmem *ctx = to_devmem(ahb);
+	void *win;
 
 	if (phys & 0x3)
 		return -EINVAL;
 
-	val = htole32(val);
-
-	if (phys >= AST_SOC_IO && phys < (AST_SOC_IO + AST_SOC_IO_LEN)) {
-		off_t offset = phys - AST_SOC_IO;
-		*(volatile uint32_t *)(((char *)ctx->io) + offset) = val;
-	} else {
-		int64_t woff;
-
-		woff = devmem_setup_win(ctx, phys, sizeof(val));
-		if (woff < 0)
-			return woff;
+	win = devmem_setup_win(ctx, phys, sizeof(val));
+	if (!win)
+		return -errno;
 
-		*(volatile uint32_t *)(((char *)ctx->win) + woff) = val;
-	}
+	*(volatile uint32_t *)win = htole32(val);
 
 	iob();
 
@@ -174,7 +231,8 @@ int devmem_writel(struct ahb *ahb, uint32_t phys, uint32_t val)
 static const struct ahb_ops devmem_ahb_ops = { .read = devmem_read,
 					       .write = devmem_write,
 					       .readl = devmem_readl,
-					       .writel = devmem_writel };
+					       .writel = devmem_writel,
+					       .map = devmem_map };
 
 static struct ahb *devmem_driver_probe(struct connection_args *connection);
 static void devmem_driver_destroy(struct ahb *ahb);
@@ -184,6 +242,12 @@ static struct bridge_driver devmem_driver = {
 	.probe = devmem_driver_probe,
 	.destroy = devmem_driver_destroy,
 	.local = true,
+	.caps = {
+		.width = 4,
+		.align = 4,
+		.cost = 1000,
+		.mmio_width = MMIO_WIDTH_DEFAULT,
+	},
 };
 REGISTER_BRIDGE_DRIVER(devmem_driver);
 
@@ -205,7 +269,12 @@ int devmem_init(struct devmem *ctx)
 		goto cleanup_fd;
 	}
 
-	ctx->win = NULL;
+	memset(ctx->wins, 0, sizeof(ctx->wins));
+	ctx->clock = 0;
+	ctx->maps = 0;
+	ctx->width = mmio_width(devmem_driver.caps.mmio_width);
+	ctx->dram_start = 0;
+	ctx->dram_end = 0;
 
 	ahb_init_ops(&ctx->ahb, &devmem_driver, &devmem_ahb_ops);
 
@@ -222,9 +291,15 @@ cleanup_fd:
 
 int devmem_destroy(struct devmem *ctx)
 {
+	size_t i;
 	int rc;
 
-	assert(!ctx->win);
+	logd("devmem: Mapped %lu windows\n", ctx->maps);
+
+	for (i = 0; i < DEVMEM_WINS; i++) {
+		if ((rc = devmem_unmap_win(&ctx->wins[i])) < 0)
+			loge("devmem: Failed to unmap window: %d\n", rc);
+	}
 
 	rc = munmap(ctx->io, AST_SOC_IO_LEN);
 	if (rc < 0) {
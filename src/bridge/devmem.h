@@ -9,14 +9,30 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+/* Mappings outside the SoC IO block, recycled least-recently-used first */
+#define DEVMEM_WINS	4
+#define DEVMEM_WIN_LEN	(1 << 20)
+
+struct devmem_win {
+	void *base;
+	uint64_t phys;
+	size_t len;
+	unsigned long used;
+};
+
 struct devmem {
 	struct ahb ahb;
 	int fd;
 	void *io;
-	void *win;
-	off_t phys;
-	size_t len;
+	struct devmem_win wins[DEVMEM_WINS];
+	unsigned long clock;
+	unsigned long maps;
 	off_t pgsize;
+	/* Access width for bulk transfers through the window */
+	unsigned int width;
+	/* DRAM, the only range devmem_map() exposes */
+	uint64_t dram_start;
+	uint64_t dram_end;
 };
 
 int devmem_init(struct devmem *ctx);
@@ -36,4 +52,6 @@ ssize_t devmem_write(struct ahb *ahb, uint32_t phys, const void *buf,
 int devmem_readl(struct ahb *ahb, uint32_t phys, uint32_t *val);
 int devmem_writel(struct ahb *ahb, uint32_t phys, uint32_t val);
 
+void *devmem_map(struct ahb *ahb, uint32_t phys, size_t *len);
+
 #endif
@@ -47,68 +47,237 @@ int ilpcb_mode(struct ilpcb *ctx)
 	return !!(hicrb & LPC_HICRB_ILPCB_RO); /* Maps to enum ilpcb_mode */
 }
 
-ssize_t ilpcb_read(struct ahb *ahb, uint32_t addr, void *buf, size_t len)
+/* Unlock the SuperIO and enable iLPC2AHB for a sequence of accesses */
+static int ilpcb_enter(struct ilpcb *ctx)
 {
-	struct ilpcb *ctx = to_ilpcb(ahb);
 	struct sio *sio = &ctx->sio;
-	size_t remaining;
-	uint8_t data;
-	int locked;
 	int rc;
 
-	if (len > SSIZE_MAX)
-		return -1;
-
 	rc = sio_unlock(sio);
 	if (rc)
-		goto done;
+		return rc;
 
 	/* Select iLPC2AHB */
+	ctx->addr_valid = false;
+	ctx->width = 0;
 	rc = sio_select(sio, sio_ilpc);
 	if (rc)
-		goto done;
+		return rc;
 
 	/* Enable iLPC2AHB */
-	rc = sio_writeb(sio, 0x30, 0x01);
+	return sio_writeb(sio, 0x30, 0x01);
+}
+
+static void ilpcb_exit(struct ilpcb *ctx)
+{
+	int locked;
+
+	ctx->addr_valid = false;
+	ctx->width = 0;
+	locked = sio_lock(&ctx->sio);
+	if (locked) {
+		errno = -locked;
+		perror("Failed to lock SuperIO device");
+	}
+}
+
+int ilpcb_session_begin(struct ilpcb *ctx)
+{
+	int rc;
+
+	if (ctx->session++)
+		return 0;
+
+	rc = ilpcb_enter(ctx);
+	if (rc) {
+		ilpcb_exit(ctx);
+		ctx->session = 0;
+	}
+
+	return rc;
+}
+
+void ilpcb_session_end(struct ilpcb *ctx)
+{
+	if (!--ctx->session)
+		ilpcb_exit(ctx);
+}
+
+static int ilpcb_set_width(struct ilpcb *ctx, uint32_t width)
+{
+	int rc;
+
+	if (width == ctx->width)
+		return 0;
+
+	/* 1-byte, 2-byte or 4-byte access */
+	rc = sio_writeb(&ctx->sio, 0xf8, width >> 1);
+	ctx->width = rc ? 0 : width;
+
+	return rc;
+}
+
+/*
+ * Sequential accesses mostly differ in the low address byte, so only rewrite
+ * the bytes that changed since the last access in this transaction.
+ */
+static int ilpcb_set_addr(struct ilpcb *ctx, uint32_t addr)
+{
+	struct sio *sio = &ctx->sio;
+	uint32_t changed;
+	uint32_t reg;
+	int rc = 0;
+
+	changed = ctx->addr_valid ? ctx->addr ^ addr : UINT32_MAX;
+
+	for (reg = 0xf0; reg <= 0xf3; reg++) {
+		int shift = 8 * (0xf3 - reg);
+
+		if ((changed >> shift) & 0xff)
+			rc |= sio_writeb(sio, reg, addr >> shift);
+	}
+
+	/* Don't trust the shadow if any of the writes went astray */
+	ctx->addr = addr;
+	ctx->addr_valid = !rc;
+
+	return rc;
+}
+
+/* Issue queued SuperIO accesses, forgetting what we know if that fails */
+static int ilpcb_flush(struct ilpcb *ctx)
+{
+	int rc;
+
+	rc = sio_flush(&ctx->sio);
+	if (rc) {
+		ctx->addr_valid = false;
+		ctx->width = 0;
+	}
+
+	return rc;
+}
+
+/*
+ * Data is held most-significant byte first in 0xf4-0xf7, right-aligned for
+ * accesses narrower than 4 bytes. The read is queued, and lands in @buf in
+ * the AHB's little-endian byte order once the SuperIO is flushed.
+ */
+static int ilpcb_queue_read(struct ilpcb *ctx, uint32_t addr, uint32_t width,
+			    uint8_t *buf)
+{
+	struct sio *sio = &ctx->sio;
+	uint32_t reg;
+	int rc;
+
+	rc = ilpcb_set_addr(ctx, addr);
 	if (rc)
-		goto done;
+		return rc;
 
-	/* 1-byte access */
-	rc = sio_writeb(sio, 0xf8, 0);
+	/* Trigger */
+	rc = sio_queue_readb(sio, 0xfe, &ctx->trigger);
 	if (rc)
-		goto done;
+		return rc;
 
-	/* XXX: Think about optimising this */
-	remaining = len;
-	while (remaining) {
-		/* Address */
-		rc |= sio_writeb(sio, 0xf0, addr >> 24);
-		rc |= sio_writeb(sio, 0xf1, addr >> 16);
-		rc |= sio_writeb(sio, 0xf2, addr >> 8);
-		rc |= sio_writeb(sio, 0xf3, addr);
+	/* Value */
+	for (reg = 0xf8 - width; reg < 0xf8; reg++) {
+		rc = sio_queue_readb(sio, reg, &buf[0xf7 - reg]);
 		if (rc)
-			goto done;
+			return rc;
+	}
+
+	return 0;
+}
+
+static int __ilpcb_read(struct ilpcb *ctx, uint32_t addr, uint32_t width,
+			uint32_t *val)
+{
+	uint8_t buf[4];
+	uint32_t i;
+	int rc;
+
+	rc = ilpcb_queue_read(ctx, addr, width, buf);
+	if (rc)
+		return rc;
+
+	rc = ilpcb_flush(ctx);
+	if (rc)
+		return rc;
+
+	*val = 0;
+	for (i = 0; i < width; i++)
+		*val |= (uint32_t)buf[i] << (8 * i);
+
+	return 0;
+}
+
+static int __ilpcb_write(struct ilpcb *ctx, uint32_t addr, uint32_t width,
+			 uint32_t val)
+{
+	struct sio *sio = &ctx->sio;
+	uint32_t reg;
+	int rc;
+
+	rc = ilpcb_set_addr(ctx, addr);
+	if (rc)
+		return rc;
+
+	/* Value */
+	for (reg = 0xf8 - width; reg < 0xf8; reg++) {
+		rc = sio_writeb(sio, reg, val >> (8 * (0xf7 - reg)));
+		if (rc)
+			return rc;
+	}
+
+	/* Trigger */
+	return sio_writeb(sio, 0xfe, 0xcf);
+}
+
+/*
+ * Move the aligned body of a bulk transfer a word at a time, which costs much
+ * the same as a byte: the unaligned head and tail fall back to byte accesses.
+ */
+static uint32_t ilpcb_bulk_width(uint32_t addr, size_t remaining)
+{
+	return (!(addr & 3) && remaining >= 4) ? 4 : 1;
+}
+
+ssize_t ilpcb_read(struct ahb *ahb, uint32_t addr, void *buf, size_t len)
+{
+	struct ilpcb *ctx = to_ilpcb(ahb);
+	uint8_t *dst = buf;
+	uint32_t width;
+	size_t remaining;
+	int rc;
+
+	if (len > SSIZE_MAX)
+		return -1;
+
+	rc = ilpcb_session_begin(ctx);
+	if (rc)
+		return -1;
 
-		/* Trigger */
-		rc = sio_readb(sio, 0xfe, &data);
+	remaining = len;
+	while (remaining) {
+		width = ilpcb_bulk_width(addr, remaining);
+		rc = ilpcb_set_width(ctx, width);
 		if (rc)
 			goto done;
 
-		rc = sio_readb(sio, 0xf7, (uint8_t *)buf);
+		/* Let the whole transfer queue up */
+		rc = ilpcb_queue_read(ctx, addr, width, dst);
 		if (rc)
 			goto done;
 
-		buf++;
-		addr++;
-		remaining--;
+		dst += width;
+		addr += width;
+		remaining -= width;
 	}
 
+	rc = ilpcb_flush(ctx);
+
 done:
-	locked = sio_lock(sio);
-	if (locked) {
-		errno = -locked;
-		perror("sio_lock");
-	}
+	ilpcb_session_end(ctx);
 
 	return rc ? -1 : (ssize_t)len;
 }
@@ -116,63 +285,46 @@ done:
 ssize_t ilpcb_write(struct ahb *ahb, uint32_t addr, const void *buf, size_t len)
 {
 	struct ilpcb *ctx = to_ilpcb(ahb);
-	struct sio *sio = &ctx->sio;
+	const uint8_t *src = buf;
+	uint32_t width;
 	size_t remaining;
-	int locked;
+	uint32_t data;
 	int rc;
 
 	if (len > SSIZE_MAX)
 		return -1;
 
-	rc = sio_unlock(sio);
-	if (rc)
-		goto done;
-
-	/* Select iLPC2AHB */
-	rc = sio_select(sio, sio_ilpc);
-	if (rc)
-		goto done;
-
-	/* Enable iLPC2AHB */
-	rc = sio_writeb(sio, 0x30, 0x01);
-	if (rc)
-		goto done;
-
-	/* 1-byte access */
-	rc = sio_writeb(sio, 0xf8, 0);
+	rc = ilpcb_session_begin(ctx);
 	if (rc)
-		goto done;
+		return -1;
 
-	/* XXX: Think about optimising this */
 	remaining = len;
 	while (remaining) {
-		/* Address */
-		rc |= sio_writeb(sio, 0xf0, addr >> 24);
-		rc |= sio_writeb(sio, 0xf1, addr >> 16);
-		rc |= sio_writeb(sio, 0xf2, addr >> 8);
-		rc |= sio_writeb(sio, 0xf3, addr);
+		width = ilpcb_bulk_width(addr, remaining);
+		rc = ilpcb_set_width(ctx, width);
 		if (rc)
 			goto done;
 
-		rc = sio_writeb(sio, 0xf7, *(uint8_t *)buf);
-		if (rc)
-			goto done;
+		data = src[0];
+		if (width == 4) {
+			data |= (uint32_t)src[1] << 8;
+			data |= (uint32_t)src[2] << 16;
+			data |= (uint32_t)src[3] << 24;
+		}
 
-		/* Trigger */
-		rc = sio_writeb(sio, 0xfe, 0xcf);
+		rc = __ilpcb_write(ctx, addr, width, data);
 		if (rc)
 			goto done;
 
-		buf++;
-		remaining--;
+		src += width;
+		addr += width;
+		remaining -= width;
 	}
 
+	rc = ilpcb_flush(ctx);
+
 done:
-	locked = sio_lock(sio);
-	if (locked) {
-		errno = -locked;
-		perror("sio_lock");
-	}
+	ilpcb_session_end(ctx);
 
 	return rc ? -1 : (ssize_t)len;
 }
@@ -181,131 +333,120 @@ done:
 int ilpcb_readl(struct ahb *ahb, uint32_t addr, uint32_t *val)
 {
 	struct ilpcb *ctx = to_ilpcb(ahb);
-	struct sio *sio = &ctx->sio;
-	uint32_t extracted;
-	uint8_t data;
-	int locked;
 	int rc;
 
-	rc = sio_unlock(sio);
+	rc = ilpcb_session_begin(ctx);
 	if (rc)
-		goto done;
+		return rc;
 
-	/* Select iLPC2AHB */
-	rc = sio_select(sio, sio_ilpc);
+	rc = ilpcb_set_width(ctx, 4);
 	if (rc)
 		goto done;
 
-	/* Enable iLPC2AHB */
-	rc = sio_writeb(sio, 0x30, 0x01);
-	if (rc)
-		goto done;
+	rc = __ilpcb_read(ctx, addr, 4, val);
 
-	/* 4-byte access */
-	rc = sio_writeb(sio, 0xf8, 2);
-	if (rc)
-		goto done;
+done:
+	ilpcb_session_end(ctx);
 
-	/* Address */
-	rc |= sio_writeb(sio, 0xf0, addr >> 24);
-	rc |= sio_writeb(sio, 0xf1, addr >> 16);
-	rc |= sio_writeb(sio, 0xf2, addr >> 8);
-	rc |= sio_writeb(sio, 0xf3, addr);
+	return rc;
+}
+
+/* Little-endian */
+int ilpcb_writel(struct ahb *ahb, uint32_t addr, uint32_t val)
+{
+	struct ilpcb *ctx = to_ilpcb(ahb);
+	int rc;
+
+	rc = ilpcb_session_begin(ctx);
 	if (rc)
-		goto done;
+		return rc;
 
-	/* Trigger */
-	rc = sio_readb(sio, 0xfe, &data);
+	rc = ilpcb_set_width(ctx, 4);
 	if (rc)
 		goto done;
 
-	/* Value */
-	extracted = 0;
-	rc |= sio_readb(sio, 0xf4, &data);
-	extracted = (extracted << 8) | data;
-	rc |= sio_readb(sio, 0xf5, &data);
-	extracted = (extracted << 8) | data;
-	rc |= sio_readb(sio, 0xf6, &data);
-	extracted = (extracted << 8) | data;
-	rc |= sio_readb(sio, 0xf7, &data);
-	extracted = (extracted << 8) | data;
+	rc = __ilpcb_write(ctx, addr, 4, val);
 	if (rc)
 		goto done;
 
-	*val = extracted;
+	rc = ilpcb_flush(ctx);
 
 done:
-	locked = sio_lock(sio);
-	if (locked) {
-		errno = -locked;
-		perror("sio_lock");
-	}
+	ilpcb_session_end(ctx);
 
 	return rc;
 }
 
-/* Little-endian */
-int ilpcb_writel(struct ahb *ahb, uint32_t addr, uint32_t val)
+int ilpcb_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n)
 {
 	struct ilpcb *ctx = to_ilpcb(ahb);
-	struct sio *sio = &ctx->sio;
-	int locked;
+	size_t i;
 	int rc;
 
-	rc = sio_unlock(sio);
+	rc = ilpcb_session_begin(ctx);
 	if (rc)
-		goto done;
+		return rc;
 
-	/* Select iLPC2AHB */
-	rc = sio_select(sio, sio_ilpc);
-	if (rc)
-		goto done;
+	for (i = 0; !rc && i < n; i++) {
+		struct ahb_vec *v = &vec[i];
 
-	/* Enable iLPC2AHB */
-	rc = sio_writeb(sio, 0x30, 0x01);
-	if (rc)
-		goto done;
+		rc = ilpcb_set_width(ctx, v->width);
+		if (rc)
+			break;
 
-	/* 4-byte access */
-	rc = sio_writeb(sio, 0xf8, 2);
-	if (rc)
-		goto done;
+		rc = __ilpcb_read(ctx, v->phys, v->width, &v->val);
+	}
 
-	/* Address */
-	rc |= sio_writeb(sio, 0xf0, addr >> 24);
-	rc |= sio_writeb(sio, 0xf1, addr >> 16);
-	rc |= sio_writeb(sio, 0xf2, addr >> 8);
-	rc |= sio_writeb(sio, 0xf3, addr >> 0);
-	if (rc)
-		goto done;
+	ilpcb_session_end(ctx);
 
-	/* Value */
-	rc |= sio_writeb(sio, 0xf4, val >> 24);
-	rc |= sio_writeb(sio, 0xf5, val >> 16);
-	rc |= sio_writeb(sio, 0xf6, val >> 8);
-	rc |= sio_writeb(sio, 0xf7, val >> 0);
-	if (rc)
-		goto done;
+	return rc;
+}
 
-	/* Trigger */
-	rc = sio_writeb(sio, 0xfe, 0xcf);
+int ilpcb_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n)
+{
+	struct ilpcb *ctx = to_ilpcb(ahb);
+	size_t i;
+	int rc;
+
+	rc = ilpcb_session_begin(ctx);
 	if (rc)
-		goto done;
+		return rc;
 
-done:
-	locked = sio_lock(sio);
-	if (locked) {
-		errno = -locked;
-		perror("Failed to lock SuperIO device");
+	for (i = 0; !rc && i < n; i++) {
+		const struct ahb_vec *v = &vec[i];
+		uint32_t val = v->val;
+
+		rc = ilpcb_set_width(ctx, v->width);
+		if (rc)
+			break;
+
+		if (v->mask) {
+			uint32_t cur;
+
+			rc = __ilpcb_read(ctx, v->phys, v->width, &cur);
+			if (rc)
+				break;
+
+			val = (cur & ~v->mask) | (val & v->mask);
+		}
+
+		rc = __ilpcb_write(ctx, v->phys, v->width, val);
 	}
 
+	if (!rc)
+		rc = ilpcb_flush(ctx);
+
+	ilpcb_session_end(ctx);
+
 	return rc;
 }
 
 static const struct ahb_ops ilpcb_ops = { .read = ilpcb_read,
 					  .write = ilpcb_write,
 					  .readl = ilpcb_readl,
-					  .writel = ilpcb_writel };
+					  .writel = ilpcb_writel,
+					  .readv = ilpcb_readv,
+					  .writev = ilpcb_writev };
 
 static struct ahb *ilpcb_driver_probe(struct connection_args *connection);
 static void ilpcb_driver_destroy(struct ahb *ahb);
@@ -314,12 +455,22 @@ static struct bridge_driver ilpcb_driver = {
 	.name = "ilpc",
 	.probe = ilpcb_driver_probe,
 	.destroy = ilpcb_driver_destroy,
+	.port_io = true,
+	.caps = {
+		.width = 4,
+		.align = 4,
+		/* A dozen or so SuperIO port accesses per word */
+		.cost = 1300 * 1000,
+	},
 };
 REGISTER_BRIDGE_DRIVER(ilpcb_driver);
 
 int ilpcb_init(struct ilpcb *ctx)
 {
 	ahb_init_ops(&ctx->ahb, &ilpcb_driver, &ilpcb_ops);
+	ctx->addr_valid = false;
+	ctx->width = 0;
+	ctx->session = 0;
 
 	return sio_init(&ctx->sio);
 }
@@ -7,6 +7,7 @@
 #include "ahb.h"
 #include "sio.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
@@ -14,12 +15,34 @@
 struct ilpcb {
 	struct ahb ahb;
 	struct sio sio;
+
+	/* The address last programmed into 0xf0-0xf3, if still valid */
+	uint32_t addr;
+	bool addr_valid;
+
+	/* The access width last programmed into 0xf8, or 0 if unknown */
+	uint32_t width;
+
+	/* Nesting depth of the sessions holding the SuperIO unlocked */
+	unsigned int session;
+
+	/* Sink for the value of queued trigger reads */
+	uint8_t trigger;
 };
 
 int ilpcb_init(struct ilpcb *ctx);
 int ilpcb_destroy(struct ilpcb *ctx);
 int ilpcb_probe(struct ilpcb *ctx);
 
+/*
+ * Keep the SuperIO unlocked with iLPC2AHB selected across a batch of accesses,
+ * rather than unlocking and relocking it around each. Sessions nest, and the
+ * SuperIO is locked again by the outermost ilpcb_session_end(), or by
+ * ilpcb_session_begin() if it fails.
+ */
+int ilpcb_session_begin(struct ilpcb *ctx);
+void ilpcb_session_end(struct ilpcb *ctx);
+
 static inline struct ahb *ilpcb_as_ahb(struct ilpcb *ctx)
 {
 	return &ctx->ahb;
@@ -33,4 +56,7 @@ ssize_t ilpcb_write(struct ahb *ahb, uint32_t addr, const void *buf,
 int ilpcb_readl(struct ahb *ahb, uint32_t addr, uint32_t *val);
 int ilpcb_writel(struct ahb *ahb, uint32_t addr, uint32_t val);
 
+int ilpcb_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n);
+int ilpcb_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n);
+
 #endif
@@ -10,6 +10,7 @@
 #include "ccan/container_of/container_of.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,51 +22,77 @@
 
 #define to_l2ab(ahb) container_of(ahb, struct l2ab, ahb)
 
-/* @return The LPC FW offset mapped to phys */
+/* Skip the writes that wouldn't change what the BMC already has */
+static int l2ab_write_hicr(struct l2ab *ctx, uint32_t reg, uint32_t *shadow,
+			   uint32_t val)
+{
+	struct ilpcb *ilpcb = &ctx->ilpcb;
+	int rc;
+
+	if (ctx->hicr_valid && *shadow == val)
+		return 0;
+
+	rc = ilpcb_writel(ilpcb_as_ahb(ilpcb), reg, val);
+	if (rc) {
+		ctx->hicr_valid = false;
+		return rc;
+	}
+
+	*shadow = val;
+
+	return 0;
+}
+
+/*
+ * The window decodes LPC FW addresses from the start of our FW space and
+ * masks them into its AHB base, so both must be aligned to its size. Opening
+ * the largest window we can every time means any working set that fits an
+ * aligned window stays mapped, and costs no more than opening a small one.
+ *
+ * @return The LPC FW offset mapped to phys
+ */
 int64_t l2ab_map(struct l2ab *ctx, uint32_t phys, size_t len)
 {
 	struct ilpcb *ilpcb = &ctx->ilpcb;
-	uint32_t aligned = phys & ~0xffff;
+	uint32_t base = phys & ~(ctx->window - 1);
 	uint32_t hicr7, hicr8;
 	int rc;
 
-	/* Check if the requested phys/len fit inside the current mapping */
-	if (phys >= ctx->phys && (phys + len) <= (ctx->phys + ctx->len))
-		return phys - ctx->phys;
-
 	/* Check if we'd intersect hiomapd/skiboot territory */
-	if (len > L2AB_WINDOW_SIZE)
+	if (len > ctx->window - (phys - base))
 		return -EINVAL;
 
-	/* Expand length to account for alignment */
-	if (len < (phys + len - aligned))
-		len = phys + len - aligned;
-
-	/*
-	 * Open a window sized to the nearest power of 2 greater than len that is
-	 * at least 2^16 bytes, due to the structure of HICR8.
-	 */
-	if (len < (1 << 16))
-		len = (1 << 16);
-
-	if (__builtin_popcount(len) != 1)
-		len = 1 << (31 - __builtin_clz(len));
+	/* Check if the requested phys/len fit inside the current mapping */
+	if (ctx->len && phys >= ctx->phys &&
+	    (phys - ctx->phys) + len <= ctx->len)
+		return phys - ctx->phys;
 
-	hicr7 = (phys & ~(0xffff));
-	hicr8 = (~(len - 1)) | ((len - 1) >> 16);
+	hicr7 = base | (ctx->fw.base >> 16);
+	hicr8 = (~(ctx->window - 1)) | ((ctx->window - 1) >> 16);
 
-	rc = ilpcb_writel(ilpcb_as_ahb(ilpcb), LPC_HICR7, hicr7);
+	/* Reprogram the window without relocking the SuperIO in between */
+	rc = ilpcb_session_begin(ilpcb);
 	if (rc)
 		return rc;
 
-	rc = ilpcb_writel(ilpcb_as_ahb(ilpcb), LPC_HICR8, hicr8);
+	rc = l2ab_write_hicr(ctx, LPC_HICR7, &ctx->hicr7, hicr7);
 	if (rc)
+		goto end_session;
+
+	rc = l2ab_write_hicr(ctx, LPC_HICR8, &ctx->hicr8, hicr8);
+
+end_session:
+	ilpcb_session_end(ilpcb);
+	if (rc) {
+		ctx->len = 0;
 		return rc;
+	}
 
-	ctx->phys = hicr7; /* This is correct as we're mapping to 0 in LPC FW */
-	ctx->len = len;
+	ctx->phys = base; /* The window starts at offset 0 of our FW space */
+	ctx->len = ctx->window;
+	ctx->remaps++;
 
-	return phys & 0xffff;
+	return phys - base;
 }
 
 ssize_t l2ab_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
@@ -80,8 +107,10 @@ ssize_t l2ab_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
 	}
 
 	do {
-		ingress = remaining > L2AB_WINDOW_SIZE ? L2AB_WINDOW_SIZE :
-							 remaining;
+		/* Stop at the end of the aligned window around phys */
+		ingress = ctx->window - (phys & (ctx->window - 1));
+		if ((size_t)ingress > remaining)
+			ingress = remaining;
 
 		offset = l2ab_map(ctx, phys, ingress);
 		if (offset < 0)
@@ -111,8 +140,10 @@ ssize_t l2ab_write(struct ahb *ahb, uint32_t phys, const void *buf, size_t len)
 	}
 
 	do {
-		egress = remaining > L2AB_WINDOW_SIZE ? L2AB_WINDOW_SIZE :
-							remaining;
+		/* Stop at the end of the aligned window around phys */
+		egress = ctx->window - (phys & (ctx->window - 1));
+		if ((size_t)egress > remaining)
+			egress = remaining;
 
 		offset = l2ab_map(ctx, phys, egress);
 		if (offset < 0)
@@ -142,11 +173,25 @@ int l2ab_writel(struct ahb *ahb, uint32_t phys, uint32_t val)
 	return ilpcb_writel(ilpcb_as_ahb(&ctx->ilpcb), phys, val);
 }
 
+int l2ab_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n)
+{
+	struct l2ab *ctx = to_l2ab(ahb);
+	return ilpcb_readv(ilpcb_as_ahb(&ctx->ilpcb), vec, n);
+}
+
+int l2ab_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n)
+{
+	struct l2ab *ctx = to_l2ab(ahb);
+	return ilpcb_writev(ilpcb_as_ahb(&ctx->ilpcb), vec, n);
+}
+
 static const struct ahb_ops l2ab_ahb_ops = {
 	.read = l2ab_read,
 	.write = l2ab_write,
 	.readl = l2ab_readl,
 	.writel = l2ab_writel,
+	.readv = l2ab_readv,
+	.writev = l2ab_writev,
 };
 
 static int l2ab_save_hicr78(struct l2ab *ctx)
@@ -154,11 +199,28 @@ static int l2ab_save_hicr78(struct l2ab *ctx)
 	struct ilpcb *ilpcb = &ctx->ilpcb;
 	int rc;
 
-	rc = ilpcb_readl(ilpcb_as_ahb(ilpcb), LPC_HICR7, &ctx->restore7);
+	rc = ilpcb_session_begin(ilpcb);
 	if (rc)
 		return rc;
 
-	return ilpcb_readl(ilpcb_as_ahb(ilpcb), LPC_HICR8, &ctx->restore8);
+	rc = ilpcb_readl(ilpcb_as_ahb(ilpcb), LPC_HICR7, &ctx->restore7);
+	if (rc)
+		goto end_session;
+
+	rc = ilpcb_readl(ilpcb_as_ahb(ilpcb), LPC_HICR8, &ctx->restore8);
+	if (rc)
+		goto end_session;
+
+	/* The BMC's configuration is what we'll find until we change it */
+	ctx->hicr7 = ctx->restore7;
+	ctx->hicr8 = ctx->restore8;
+	ctx->hicr_valid = true;
+	ctx->len = 0;
+
+end_session:
+	ilpcb_session_end(ilpcb);
+
+	return rc;
 }
 
 static int l2ab_restore_hicr78(struct l2ab *ctx)
@@ -166,11 +228,23 @@ static int l2ab_restore_hicr78(struct l2ab *ctx)
 	struct ilpcb *ilpcb = &ctx->ilpcb;
 	int rc;
 
-	rc = ilpcb_writel(ilpcb_as_ahb(ilpcb), LPC_HICR8, ctx->restore8);
+	rc = ilpcb_session_begin(ilpcb);
 	if (rc)
 		return rc;
 
-	return ilpcb_writel(ilpcb_as_ahb(ilpcb), LPC_HICR7, ctx->restore7);
+	/* Whatever happens, our window is gone */
+	ctx->len = 0;
+
+	rc = l2ab_write_hicr(ctx, LPC_HICR8, &ctx->hicr8, ctx->restore8);
+	if (rc)
+		goto end_session;
+
+	rc = l2ab_write_hicr(ctx, LPC_HICR7, &ctx->hicr7, ctx->restore7);
+
+end_session:
+	ilpcb_session_end(ilpcb);
+
+	return rc;
 }
 
 static struct ahb *l2ab_driver_probe(struct connection_args *connection);
@@ -184,6 +258,14 @@ static struct bridge_driver l2ab_driver = {
 	.destroy = l2ab_driver_destroy,
 	.reinit = l2ab_driver_reinit,
 	.release = l2ab_driver_release,
+	.port_io = true,
+	.caps = {
+		.width = 4,
+		.align = 4,
+		.window = L2AB_WINDOW_SIZE,
+		/* LPC firmware cycles */
+		.cost = 300 * 1000,
+	},
 };
 REGISTER_BRIDGE_DRIVER(l2ab_driver);
 
@@ -200,9 +282,40 @@ int l2ab_init(struct l2ab *ctx)
 	if (rc)
 		return rc;
 
+	/* Returns 1 if the bridge was found */
 	rc = ilpcb_probe(ilpcb);
-	if (rc)
+	if (rc <= 0) {
+		if (!rc)
+			rc = -ENODEV;
 		goto cleanup;
+	}
+
+	/* Nothing mapped yet */
+	ctx->phys = 0;
+	ctx->len = 0;
+	ctx->remaps = 0;
+	ctx->hicr_valid = false;
+
+	/* Windows are a power of two, and at least 64kiB due to HICR8 */
+	ctx->window = L2AB_WINDOW_SIZE;
+	if (ctx->fw.size && ctx->fw.size < ctx->window) {
+		if (ctx->fw.size < (1 << 16)) {
+			loge("l2a: LPC FW space is too small for a window\n");
+			rc = -EINVAL;
+			goto cleanup;
+		}
+
+		ctx->window = (size_t)1 << (31 - __builtin_clz(ctx->fw.size));
+	}
+
+	/* HICR7 can only place the window at a multiple of its size */
+	if (ctx->fw.base & (ctx->window - 1)) {
+		loge("l2a: LPC FW space at 0x%08" PRIx32
+		     " isn't aligned to its %zukiB window\n",
+		     ctx->fw.base, ctx->window >> 10);
+		rc = -EINVAL;
+		goto cleanup;
+	}
 
 	rc = l2ab_save_hicr78(ctx);
 	if (rc)
@@ -223,6 +336,9 @@ int l2ab_destroy(struct l2ab *ctx)
 {
 	int rc;
 
+	logd("l2a: Opened %lu %zukiB windows\n", ctx->remaps,
+	     ctx->window >> 10);
+
 	rc = l2ab_restore_hicr78(ctx);
 	if (rc)
 		return rc;
@@ -8,6 +8,7 @@
 #include "lpc.h"
 #include "ilpc.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -17,8 +18,15 @@ struct l2ab {
 	struct ilpcb ilpcb;
 	uint32_t phys;
 	size_t len;
+	/* The largest window the LPC FW space can reach */
+	size_t window;
+	unsigned long remaps;
 	uint32_t restore7;
 	uint32_t restore8;
+	/* What we last read from or wrote to HICR7/8 */
+	uint32_t hicr7;
+	uint32_t hicr8;
+	bool hicr_valid;
 };
 
 int l2ab_init(struct l2ab *ctx);
@@ -37,4 +45,7 @@ ssize_t l2ab_write(struct ahb *ahb, uint32_t phys, const void *buf, size_t len);
 int l2ab_readl(struct ahb *ahb, uint32_t phys, uint32_t *val);
 int l2ab_writel(struct ahb *ahb, uint32_t phys, uint32_t val);
 
+int l2ab_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n);
+int l2ab_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n);
+
 #endif
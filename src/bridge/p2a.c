@@ -90,11 +90,15 @@ int p2ab_probe(struct p2ab *ctx)
 	return rc < 0 ? rc : 1;
 }
 
-int64_t p2ab_map(struct p2ab *ctx, uint32_t phys, size_t len __unused)
+/*
+ * Moving the window only needs a fence before the window is read. Stores to
+ * the BAR are performed in program order, so a sequence of writes can move the
+ * window and fence once at the end.
+ */
+static uint32_t __p2ab_map(struct p2ab *ctx, uint32_t phys, bool fence)
 {
 	uint32_t rbar;
 	uint32_t offset;
-	int64_t rc;
 
 	rbar = phys & P2AB_RBAR_REMAP_MASK;
 	offset = phys & ~P2AB_RBAR_REMAP_MASK;
@@ -102,16 +106,21 @@ int64_t p2ab_map(struct p2ab *ctx, uint32_t phys, size_t len __unused)
 	if (ctx->rbar == rbar)
 		return offset;
 
-	rc = __p2ab_writel(ctx, P2AB_RBAR, rbar);
-
-	if (rc < 0)
-		return rc;
+	*((volatile uint32_t *)(ctx->mmio + P2AB_RBAR)) = htole32(rbar);
+	if (fence)
+		iob();
 
 	ctx->rbar = rbar;
+	ctx->ahb.stats.remaps++;
 
 	return offset;
 }
 
+int64_t p2ab_map(struct p2ab *ctx, uint32_t phys, size_t len __unused)
+{
+	return __p2ab_map(ctx, phys, true);
+}
+
 ssize_t p2ab_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
 {
 	struct p2ab *ctx = to_p2ab(ahb);
@@ -124,14 +133,17 @@ ssize_t p2ab_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
 	}
 
 	do {
-		ingress = remaining > P2AB_WINDOW_LEN ? P2AB_WINDOW_LEN :
-							remaining;
+		/* Don't run off the end of the window */
+		ingress = P2AB_WINDOW_LEN - (phys & (P2AB_WINDOW_LEN - 1));
+		if (ingress > remaining)
+			ingress = remaining;
 
 		rc = p2ab_map(ctx, phys, ingress);
 		if (rc < 0)
 			return -1;
 
-		mmio_memcpy(buf, (ctx->mmio + P2AB_WINDOW_BASE + rc), ingress);
+		mmio_read(buf, (ctx->mmio + P2AB_WINDOW_BASE + rc), ingress,
+			  ctx->width);
 		phys += ingress;
 		buf += ingress;
 		remaining -= ingress;
@@ -143,6 +155,7 @@ ssize_t p2ab_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
 ssize_t p2ab_write(struct ahb *ahb, uint32_t phys, const void *buf, size_t len)
 {
 	struct p2ab *ctx = to_p2ab(ahb);
+	void *win = ctx->wc ?: ctx->mmio;
 	size_t remaining = len;
 	size_t egress;
 	int64_t rc;
@@ -152,14 +165,21 @@ ssize_t p2ab_write(struct ahb *ahb, uint32_t phys, const void *buf, size_t len)
 	}
 
 	do {
-		egress = remaining > P2AB_WINDOW_LEN ? P2AB_WINDOW_LEN :
-						       remaining;
+		egress = P2AB_WINDOW_LEN - (phys & (P2AB_WINDOW_LEN - 1));
+		if (egress > remaining)
+			egress = remaining;
 
 		rc = p2ab_map(ctx, phys, egress);
 		if (rc < 0)
 			return -1;
 
-		mmio_memcpy((ctx->mmio + P2AB_WINDOW_BASE + rc), buf, egress);
+		/*
+		 * Through the write-combining mapping the stores are posted
+		 * in bursts, and the fence ending mmio_write() drains them
+		 * before we touch P2AB_RBAR again.
+		 */
+		mmio_write((win + P2AB_WINDOW_BASE + rc), buf, egress,
+			   ctx->width);
 		phys += egress;
 		buf += egress;
 		remaining -= egress;
@@ -204,11 +224,64 @@ int p2ab_writel(struct ahb *ahb, uint32_t phys, uint32_t val)
 	return 0;
 }
 
+/*
+ * Callers rely on the elements landing in order even across windows, e.g. the
+ * SFC's control register and then its flash window, so the writes can't be
+ * regrouped by window. There's deliberately no per-window write queue for the
+ * same reason. What we can avoid is fencing each time the window moves.
+ */
+int p2ab_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n)
+{
+	struct p2ab *ctx = to_p2ab(ahb);
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		const struct ahb_vec *v = &vec[i];
+		uint32_t full, val, cur;
+		void *reg;
+
+		reg = ctx->mmio + P2AB_WINDOW_BASE +
+		      __p2ab_map(ctx, v->phys, false);
+
+		full = v->width == 4 ? 0xffffffff :
+				       ((1U << (8 * v->width)) - 1);
+		val = v->val & full;
+
+		if (v->mask && (v->mask & full) != full) {
+			/* The read must observe the writes before it */
+			iob();
+
+			if (v->width == 4)
+				cur = le32toh(*(volatile uint32_t *)reg);
+			else if (v->width == 2)
+				cur = le16toh(*(volatile uint16_t *)reg);
+			else
+				cur = *(volatile uint8_t *)reg;
+
+			val = (cur & ~v->mask) | (val & v->mask);
+		}
+
+		if (v->width == 4)
+			*(volatile uint32_t *)reg = htole32(val);
+		else if (v->width == 2)
+			*(volatile uint16_t *)reg = htole16(val);
+		else
+			*(volatile uint8_t *)reg = val;
+	}
+
+	iob();
+
+	ctx->ahb.stats.batches++;
+
+	return 0;
+}
+
 static const struct ahb_ops p2ab_ahb_ops = {
 	.read = p2ab_read,
 	.write = p2ab_write,
 	.readl = p2ab_readl,
 	.writel = p2ab_writel,
+	.writev = p2ab_writev,
 };
 
 static struct ahb *p2ab_driver_probe(struct connection_args *connection);
@@ -220,13 +293,51 @@ static struct bridge_driver p2ab_driver = {
 	.probe = p2ab_driver_probe,
 	.reinit = p2ab_driver_reinit,
 	.destroy = p2ab_driver_destroy,
+	.caps = {
+		.width = 4,
+		.align = 4,
+		.window = P2AB_WINDOW_LEN,
+		/* Non-posted MMIO reads dominate */
+		.cost = 50 * 1000,
+		/* The AHB is 32 bits wide, wider reads may not be split */
+		.mmio_width = 4,
+	},
 };
 REGISTER_BRIDGE_DRIVER(p2ab_driver);
 
+static struct ahb *p2ab_bmc_driver_probe(struct connection_args *connection);
+
+/*
+ * The BMC device's P2A registers can stand in for the VGA device's when that's
+ * gated. This is the same 64kiB window path that cmd/p2a drives, nothing more:
+ * the device's fixed 4kiB MMIO function is deliberately not implemented, and
+ * neither is concurrent use with the p2a bridge. We don't know that the two
+ * devices' PKR and RBAR are independent, so it's only used when asked for with
+ * 'via p2a-bmc'.
+ */
+static struct bridge_driver p2ab_bmc_driver = {
+	.name = "p2a-bmc",
+	.probe = p2ab_bmc_driver_probe,
+	.reinit = p2ab_driver_reinit,
+	.destroy = p2ab_driver_destroy,
+	.explicit_only = true,
+	.caps = {
+		.width = 4,
+		.align = 4,
+		.window = P2AB_WINDOW_LEN,
+		.cost = 50 * 1000,
+		.mmio_width = 4,
+	},
+};
+REGISTER_BRIDGE_DRIVER(p2ab_bmc_driver);
+
 int p2ab_init(struct p2ab *ctx, uint16_t vid, uint16_t did)
 {
+	struct bridge_driver *driver;
 	int rc;
 
+	driver = did == AST_PCI_DID_BMC ? &p2ab_bmc_driver : &p2ab_driver;
+
 	rc = pci_open(vid, did, AST_MMIO_BAR);
 	if (rc < 0)
 		return rc;
@@ -239,6 +350,8 @@ int p2ab_init(struct p2ab *ctx, uint16_t vid, uint16_t did)
 		goto cleanup_pci;
 	}
 
+	ctx->wc = NULL;
+
 	/* ensure the HW and SW rbar values are in sync */
 	ctx->rbar = 0;
 	__p2ab_writel(ctx, P2AB_RBAR, ctx->rbar);
@@ -246,7 +359,11 @@ int p2ab_init(struct p2ab *ctx, uint16_t vid, uint16_t did)
 	if ((rc = p2ab_unlock(ctx)) < 0)
 		goto cleanup_mmap;
 
-	ahb_init_ops(&ctx->ahb, &p2ab_driver, &p2ab_ahb_ops);
+	ctx->width = mmio_width(driver->caps.mmio_width);
+	logd("%s: Using %u-byte accesses for bulk transfers\n", driver->name,
+	     ctx->width);
+
+	ahb_init_ops(&ctx->ahb, driver, &p2ab_ahb_ops);
 
 	return 0;
 
@@ -259,14 +376,48 @@ cleanup_pci:
 	return rc;
 }
 
+/*
+ * Map the BAR again with write-combining for p2ab_write(). Reads and register
+ * accesses stay on the uncached mapping, as speculative or merged accesses
+ * could have side-effects.
+ */
+int p2ab_enable_wc(struct p2ab *ctx, uint16_t vid, uint16_t did)
+{
+	int rc;
+
+	rc = pci_open_wc(vid, did, AST_MMIO_BAR);
+	if (rc < 0)
+		return rc;
+
+	ctx->wc_res = rc;
+	ctx->wc = mmap(0, AST_MMIO_LEN, PROT_READ | PROT_WRITE, MAP_SHARED,
+		       ctx->wc_res, 0);
+	if (ctx->wc == MAP_FAILED) {
+		rc = -errno;
+		ctx->wc = NULL;
+		pci_close(ctx->wc_res);
+		return rc;
+	}
+
+	return 0;
+}
+
 int p2ab_destroy(struct p2ab *ctx)
 {
 	int rc;
 
+	logd("%s: Moved the window %" PRIu64 " times, %" PRIu64 " batches\n",
+	     ctx->ahb.drv->name, ctx->ahb.stats.remaps, ctx->ahb.stats.batches);
+
 	rc = p2ab_lock(ctx);
 	if (rc < 0)
 		return rc;
 
+	if (ctx->wc) {
+		munmap(ctx->wc, AST_MMIO_LEN);
+		pci_close(ctx->wc_res);
+	}
+
 	rc = munmap(ctx->mmio, AST_MMIO_LEN);
 	if (rc == -1)
 		return -errno;
@@ -274,8 +425,8 @@ int p2ab_destroy(struct p2ab *ctx)
 	return pci_close(ctx->res);
 }
 
-static struct ahb *
-p2ab_driver_probe(struct connection_args *connection __unused)
+static struct ahb *__p2ab_driver_probe(struct connection_args *connection,
+				       uint16_t did)
 {
 	struct p2ab *ctx;
 	int rc;
@@ -285,16 +436,35 @@ p2ab_driver_probe(struct connection_args *connection __unused)
 		return NULL;
 	}
 
-	if ((rc = p2ab_init(ctx, AST_PCI_VID, AST_PCI_DID_VGA)) < 0) {
-		logd("Failed to initialise P2A bridge: %d\n", rc);
+	if ((rc = p2ab_init(ctx, AST_PCI_VID, did)) < 0) {
+		logd("Failed to initialise P2A bridge on device 0x%04x: %d\n",
+		     did, rc);
 		goto cleanup_ctx;
 	}
 
+	/* Opening the device can be slow, don't go on if we were abandoned */
+	if (bridge_probe_cancelled()) {
+		rc = -ECANCELED;
+		goto destroy_ctx;
+	}
+
 	if ((rc = p2ab_probe(ctx)) < 0) {
 		logd("Failed P2A probe: %d\n", rc);
 		goto destroy_ctx;
 	}
 
+	/* via p2a wc, via p2a-bmc wc */
+	if (connection->bridge_driver == ctx->ahb.drv &&
+	    connection->interface && !strcmp(connection->interface, "wc")) {
+		rc = p2ab_enable_wc(ctx, AST_PCI_VID, did);
+		if (rc < 0)
+			loge("%s: Write-combining unavailable, writes will be uncached: %d\n",
+			     ctx->ahb.drv->name, rc);
+		else
+			logi("%s: Writing through a write-combining mapping\n",
+			     ctx->ahb.drv->name);
+	}
+
 	return p2ab_as_ahb(ctx);
 
 destroy_ctx:
@@ -306,6 +476,16 @@ cleanup_ctx:
 	return NULL;
 }
 
+static struct ahb *p2ab_driver_probe(struct connection_args *connection)
+{
+	return __p2ab_driver_probe(connection, AST_PCI_DID_VGA);
+}
+
+static struct ahb *p2ab_bmc_driver_probe(struct connection_args *connection)
+{
+	return __p2ab_driver_probe(connection, AST_PCI_DID_BMC);
+}
+
 static int p2ab_driver_reinit(struct ahb *ahb)
 {
 	struct p2ab *ctx = to_p2ab(ahb);
@@ -18,11 +18,17 @@ struct p2ab {
 	int res;
 	void *mmio;
 	uint32_t rbar;
+	/* A write-combining mapping of the BAR for bulk writes, or NULL */
+	int wc_res;
+	void *wc;
+	/* Access width for bulk transfers through the window */
+	unsigned int width;
 };
 
 int p2ab_init(struct p2ab *p2ab, uint16_t vid, uint16_t did);
 int p2ab_destroy(struct p2ab *p2ab);
 int p2ab_probe(struct p2ab *p2ab);
+int p2ab_enable_wc(struct p2ab *p2ab, uint16_t vid, uint16_t did);
 
 int64_t p2ab_map(struct p2ab *p2ab, uint32_t phys, size_t len);
 
@@ -37,4 +43,6 @@ ssize_t p2ab_write(struct ahb *ahb, uint32_t phys, const void *buf, size_t len);
 int p2ab_readl(struct ahb *ahb, uint32_t phys, uint32_t *val);
 int p2ab_writel(struct ahb *ahb, uint32_t phys, uint32_t val);
 
+int p2ab_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n);
+
 #endif
@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ahb.h"
+#include "bridge.h"
+#include "log.h"
+#include "record.h"
+
+#include "ccan/container_of/container_of.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define to_recb(ahb) container_of(ahb, struct recb, ahb)
+
+/* How long the writer thread naps when the ring is empty */
+#define RECB_IDLE_NS 1000000
+
+uint64_t recb_hash(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	/* FNV-1a */
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static void recb_push(struct recb *ctx, const struct recb_entry *entry)
+{
+	unsigned long head = ctx->head;
+
+	/* Never drop entries, the writer will free up space shortly */
+	while (head - __atomic_load_n(&ctx->tail, __ATOMIC_ACQUIRE) ==
+	       RECB_RING_ENTRIES)
+		sched_yield();
+
+	ctx->ring[head % RECB_RING_ENTRIES] = *entry;
+	__atomic_store_n(&ctx->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void recb_log(struct recb *ctx, enum ahb_op op, uint64_t start,
+		     uint64_t end, uint32_t phys, uint32_t width, uint32_t len,
+		     uint64_t val, int err)
+{
+	struct recb_entry entry = {
+		.ts_ns = start - ctx->epoch,
+		.duration_ns = end - start > UINT32_MAX ? UINT32_MAX :
+							  end - start,
+		.op = op,
+		.width = width,
+		.err = err,
+		.phys = phys,
+		.len = len,
+		.val = val,
+	};
+
+	recb_push(ctx, &entry);
+}
+
+static int recb_write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t rc;
+
+	while (len) {
+		rc = write(fd, p, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		p += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+static void *recb_writer(void *arg)
+{
+	const struct timespec idle = { .tv_nsec = RECB_IDLE_NS };
+	struct recb *ctx = arg;
+	unsigned long head, tail, idx, n;
+	bool stop;
+	int rc;
+
+	for (;;) {
+		/* Observe stop before head so we can't miss the final entries */
+		stop = __atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&ctx->head, __ATOMIC_ACQUIRE);
+		tail = ctx->tail;
+
+		if (head == tail) {
+			if (stop)
+				break;
+
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		/* Write up to the end of the ring, the wrap is picked up next */
+		idx = tail % RECB_RING_ENTRIES;
+		n = head - tail;
+		if (n > RECB_RING_ENTRIES - idx)
+			n = RECB_RING_ENTRIES - idx;
+
+		/* Keep draining after an error so the bridge doesn't stall */
+		if (!ctx->err) {
+			rc = recb_write_all(ctx->fd, &ctx->ring[idx],
+					    n * sizeof(*ctx->ring));
+			if (rc < 0) {
+				loge("record: Failed to write log: %d\n", rc);
+				ctx->err = rc;
+			}
+		}
+
+		__atomic_store_n(&ctx->tail, tail + n, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+ssize_t recb_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
+{
+	struct recb *ctx = to_recb(ahb);
+	uint64_t start = ahb_stats_now();
+	ssize_t rc;
+
+	rc = ahb_read(ctx->inner, phys, buf, len);
+	recb_log(ctx, ahb_op_read, start, ahb_stats_now(), phys, 0, len,
+		 rc < 0 ? 0 : recb_hash(buf, rc), rc < 0 ? rc : 0);
+
+	return rc;
+}
+
+ssize_t recb_write(struct ahb *ahb, uint32_t phys, const void *buf,
+		   size_t len)
+{
+	struct recb *ctx = to_recb(ahb);
+	uint64_t start = ahb_stats_now();
+	ssize_t rc;
+
+	rc = ahb_write(ctx->inner, phys, buf, len);
+	recb_log(ctx, ahb_op_write, start, ahb_stats_now(), phys, 0, len,
+		 recb_hash(buf, len), rc < 0 ? rc : 0);
+
+	return rc;
+}
+
+int recb_readl(struct ahb *ahb, uint32_t phys, uint32_t *val)
+{
+	struct recb *ctx = to_recb(ahb);
+	uint64_t start = ahb_stats_now();
+	int rc;
+
+	rc = ahb_readl(ctx->inner, phys, val);
+	recb_log(ctx, ahb_op_readl, start, ahb_stats_now(), phys, 4, 4,
+		 rc ? 0 : *val, rc);
+
+	return rc;
+}
+
+int recb_writel(struct ahb *ahb, uint32_t phys, uint32_t val)
+{
+	struct recb *ctx = to_recb(ahb);
+	uint64_t start = ahb_stats_now();
+	int rc;
+
+	rc = ahb_writel(ctx->inner, phys, val);
+	recb_log(ctx, ahb_op_writel, start, ahb_stats_now(), phys, 4, 4, val,
+		 rc);
+
+	return rc;
+}
+
+int recb_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n)
+{
+	struct recb *ctx = to_recb(ahb);
+	uint64_t start = ahb_stats_now();
+	uint64_t end, share;
+	size_t i;
+	int rc;
+
+	rc = ahb_readv(ctx->inner, vec, n);
+	end = ahb_stats_now();
+
+	/* Apportion the transaction's time evenly across its elements */
+	share = n ? (end - start) / n : 0;
+	for (i = 0; i < n; i++) {
+		recb_log(ctx, ahb_op_readv, start, start + share, vec[i].phys,
+			 vec[i].width, vec[i].width, rc ? 0 : vec[i].val, rc);
+	}
+
+	return rc;
+}
+
+int recb_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n)
+{
+	struct recb *ctx = to_recb(ahb);
+	uint64_t start = ahb_stats_now();
+	uint64_t end, share;
+	size_t i;
+	int rc;
+
+	rc = ahb_writev(ctx->inner, vec, n);
+	end = ahb_stats_now();
+
+	share = n ? (end - start) / n : 0;
+	for (i = 0; i < n; i++) {
+		recb_log(ctx, ahb_op_writev, start, start + share, vec[i].phys,
+			 vec[i].width, vec[i].width,
+			 ((uint64_t)vec[i].mask << 32) | vec[i].val, rc);
+	}
+
+	return rc;
+}
+
+static int recb_release(struct ahb *ahb)
+{
+	return ahb_release_bridge(to_recb(ahb)->inner);
+}
+
+static int recb_reinit(struct ahb *ahb)
+{
+	return ahb_reinit_bridge(to_recb(ahb)->inner);
+}
+
+static const struct ahb_ops recb_ahb_ops = {
+	.read = recb_read,
+	.write = recb_write,
+	.readl = recb_readl,
+	.writel = recb_writel,
+	.readv = recb_readv,
+	.writev = recb_writev,
+};
+
+/* Not registered: the recorder is only ever stacked on a probed bridge */
+static const struct bridge_driver recb_driver = {
+	.name = "record",
+	.release = recb_release,
+	.reinit = recb_reinit,
+};
+
+int recb_init(struct recb *ctx, struct ahb *inner, const char *path)
+{
+	struct recb_header header = {
+		.magic = RECB_MAGIC,
+		.version = RECB_VERSION,
+		.entry_size = sizeof(struct recb_entry),
+	};
+	int rc;
+
+	ctx->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (ctx->fd < 0) {
+		rc = -errno;
+		loge("record: Failed to open '%s': %d\n", path, rc);
+		return rc;
+	}
+
+	if ((rc = recb_write_all(ctx->fd, &header, sizeof(header))) < 0)
+		goto cleanup_fd;
+
+	ctx->ring = malloc(RECB_RING_ENTRIES * sizeof(*ctx->ring));
+	if (!ctx->ring) {
+		rc = -ENOMEM;
+		goto cleanup_fd;
+	}
+
+	ctx->inner = inner;
+	ctx->head = 0;
+	ctx->tail = 0;
+	ctx->stop = false;
+	ctx->err = 0;
+	ctx->epoch = ahb_stats_now();
+
+	if ((rc = -pthread_create(&ctx->writer, NULL, recb_writer, ctx)))
+		goto cleanup_ring;
+
+	ahb_init_ops(&ctx->ahb, &recb_driver, &recb_ahb_ops);
+
+	logd("record: Recording %s bridge accesses to '%s'\n",
+	     inner->drv->name, path);
+
+	return 0;
+
+cleanup_ring:
+	free(ctx->ring);
+
+cleanup_fd:
+	close(ctx->fd);
+
+	return rc;
+}
+
+int recb_destroy(struct recb *ctx)
+{
+	int rc;
+
+	__atomic_store_n(&ctx->stop, true, __ATOMIC_RELEASE);
+	pthread_join(ctx->writer, NULL);
+
+	free(ctx->ring);
+
+	rc = close(ctx->fd) ? -errno : 0;
+
+	return ctx->err ? ctx->err : rc;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef _BRIDGE_RECORD_H
+#define _BRIDGE_RECORD_H
+
+#include "ahb.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * A recording is a struct recb_header followed by a struct recb_entry for each
+ * access, all in host byte order. Vectored transactions are recorded as one
+ * entry per element sharing a timestamp.
+ */
+#define RECB_MAGIC   "CULVREC"
+#define RECB_VERSION 1
+
+struct recb_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+};
+
+struct recb_entry {
+	/* Relative to the start of the recording */
+	uint64_t ts_ns;
+	uint32_t duration_ns;
+	/* enum ahb_op */
+	uint8_t op;
+	/* The register width, or 0 for bulk transfers */
+	uint8_t width;
+	/* Negative errno if the access failed */
+	int16_t err;
+	uint32_t phys;
+	uint32_t len;
+	/*
+	 * The register value, with the mask in the upper half for writev. For
+	 * bulk transfers, a hash of the payload.
+	 */
+	uint64_t val;
+};
+
+#define RECB_RING_ENTRIES 4096
+
+struct recb {
+	struct ahb ahb;
+	struct ahb *inner;
+	int fd;
+	uint64_t epoch;
+
+	/* Single-producer, single-consumer ring drained by the writer thread */
+	struct recb_entry *ring;
+	unsigned long head;
+	unsigned long tail;
+	bool stop;
+	int err;
+	pthread_t writer;
+};
+
+int recb_init(struct recb *ctx, struct ahb *inner, const char *path);
+int recb_destroy(struct recb *ctx);
+
+static inline struct ahb *recb_as_ahb(struct recb *ctx)
+{
+	return &ctx->ahb;
+}
+
+uint64_t recb_hash(const void *buf, size_t len);
+
+ssize_t recb_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len);
+ssize_t recb_write(struct ahb *ahb, uint32_t phys, const void *buf,
+		   size_t len);
+
+int recb_readl(struct ahb *ahb, uint32_t phys, uint32_t *val);
+int recb_writel(struct ahb *ahb, uint32_t phys, uint32_t val);
+
+int recb_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n);
+int recb_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n);
+
+#endif
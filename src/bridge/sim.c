@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ahb.h"
+#include "array.h"
+#include "bridge.h"
+#include "compiler.h"
+#include "connection.h"
+#include "debug.h"
+#include "log.h"
+#include "rev.h"
+#include "sim.h"
+
+#include "ccan/container_of/container_of.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define to_simb(ahb) container_of(ahb, struct simb, ahb)
+
+/*
+ * Rough access costs of the real bridges, for exercising culvert's transfer
+ * paths under representative conditions.
+ */
+static const struct simb_latency {
+	const char *name;
+	uint64_t op_ns;
+	uint64_t byte_ns;
+} simb_latencies[] = {
+	{ "none", 0, 0 },
+	/* Non-posted PCIe MMIO through the 64kiB window */
+	{ "p2a", 1000, 50 },
+	/* A dozen or so SuperIO port accesses per word */
+	{ "ilpc", 1000, 1300 },
+	/* Shell commands over a 115200 baud UART */
+	{ "debug", 300000, DEBUG_KIB_NS / 1024 },
+};
+
+static void simb_delay(struct simb *ctx, size_t len)
+{
+	struct timespec ts;
+	uint64_t now, deadline;
+
+	if (!ctx->op_ns && !ctx->byte_ns)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	deadline = now + ctx->op_ns + len * ctx->byte_ns;
+
+	/* Sleeping overshoots by tens of microseconds, so spin out the tail */
+	if (deadline - now > 100000) {
+		uint64_t nap = deadline - now - 50000;
+
+		ts.tv_sec = nap / 1000000000ULL;
+		ts.tv_nsec = nap % 1000000000ULL;
+		nanosleep(&ts, NULL);
+	}
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	} while (now < deadline);
+}
+
+ssize_t simb_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
+{
+	struct simb *ctx = to_simb(ahb);
+
+	simb_delay(ctx, len);
+
+	return sim_soc_read(&ctx->soc, phys, buf, len);
+}
+
+ssize_t simb_write(struct ahb *ahb, uint32_t phys, const void *buf,
+		   size_t len)
+{
+	struct simb *ctx = to_simb(ahb);
+
+	simb_delay(ctx, len);
+
+	return sim_soc_write(&ctx->soc, phys, buf, len);
+}
+
+int simb_readl(struct ahb *ahb, uint32_t phys, uint32_t *val)
+{
+	struct simb *ctx = to_simb(ahb);
+
+	simb_delay(ctx, sizeof(*val));
+
+	return sim_soc_readl(&ctx->soc, phys, val);
+}
+
+int simb_writel(struct ahb *ahb, uint32_t phys, uint32_t val)
+{
+	struct simb *ctx = to_simb(ahb);
+
+	simb_delay(ctx, sizeof(val));
+
+	return sim_soc_writel(&ctx->soc, phys, val);
+}
+
+static const struct ahb_ops simb_ahb_ops = {
+	.read = simb_read,
+	.write = simb_write,
+	.readl = simb_readl,
+	.writel = simb_writel,
+};
+
+static struct ahb *simb_driver_probe(struct connection_args *connection);
+static void simb_driver_destroy(struct ahb *ahb);
+
+static struct bridge_driver simb_driver = {
+	.name = "sim",
+	.probe = simb_driver_probe,
+	.destroy = simb_driver_destroy,
+	.path_required = true,
+};
+REGISTER_BRIDGE_DRIVER(simb_driver);
+
+static int simb_parse_latency(struct simb *ctx, const char *latency)
+{
+	unsigned long long op_ns, byte_ns = 0;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(simb_latencies); i++) {
+		if (!strcmp(latency, simb_latencies[i].name)) {
+			ctx->op_ns = simb_latencies[i].op_ns;
+			ctx->byte_ns = simb_latencies[i].byte_ns;
+			return 0;
+		}
+	}
+
+	/* Otherwise, OP_NS[:BYTE_NS] */
+	if (sscanf(latency, "%llu:%llu", &op_ns, &byte_ns) < 1)
+		return -EINVAL;
+
+	ctx->op_ns = op_ns;
+	ctx->byte_ns = byte_ns;
+
+	return 0;
+}
+
+/* IMAGE[,soc=SOC][,latency=LATENCY] */
+int simb_init(struct simb *ctx, const char *args)
+{
+	const char *soc = "ast2500";
+	char *opts, *image, *opt, *save;
+	int rc;
+
+	ctx->op_ns = 0;
+	ctx->byte_ns = 0;
+
+	if (!(opts = strdup(args)))
+		return -ENOMEM;
+
+	image = strtok_r(opts, ",", &save);
+	if (!image) {
+		rc = -EINVAL;
+		goto cleanup_opts;
+	}
+
+	while ((opt = strtok_r(NULL, ",", &save))) {
+		if (!strncmp(opt, "soc=", strlen("soc="))) {
+			soc = opt + strlen("soc=");
+		} else if (!strncmp(opt, "latency=", strlen("latency="))) {
+			rc = simb_parse_latency(ctx, opt + strlen("latency="));
+			if (rc < 0) {
+				loge("sim: Invalid latency '%s'\n", opt);
+				goto cleanup_opts;
+			}
+		} else {
+			loge("sim: Unrecognised option '%s'\n", opt);
+			rc = -EINVAL;
+			goto cleanup_opts;
+		}
+	}
+
+	if ((rc = sim_soc_init(&ctx->soc, image, soc)) < 0)
+		goto cleanup_opts;
+
+	logd("sim: Injecting %" PRIu64 "ns per access and %" PRIu64
+	     "ns per byte\n",
+	     ctx->op_ns, ctx->byte_ns);
+
+	ahb_init_ops(&ctx->ahb, &simb_driver, &simb_ahb_ops);
+
+	rc = 0;
+
+cleanup_opts:
+	free(opts);
+
+	return rc;
+}
+
+int simb_destroy(struct simb *ctx)
+{
+	sim_soc_destroy(&ctx->soc);
+
+	return 0;
+}
+
+static struct ahb *simb_driver_probe(struct connection_args *connection)
+{
+	struct simb *ctx;
+	int64_t rc;
+
+	/* Never stand in for real hardware unless explicitly requested */
+	if (connection->bridge_driver != &simb_driver) {
+		logd("sim: Bridge not explicitly selected, skipping\n");
+		return NULL;
+	}
+
+	if (!connection->interface) {
+		loge("sim: An image path is required\n");
+		return NULL;
+	}
+
+	ctx = malloc(sizeof(*ctx));
+	if (!ctx) {
+		return NULL;
+	}
+
+	if ((rc = simb_init(ctx, connection->interface)) < 0) {
+		loge("Failed to initialise sim bridge: %" PRId64 "\n", rc);
+		goto cleanup_ctx;
+	}
+
+	if ((rc = rev_probe(simb_as_ahb(ctx))) < 0) {
+		loge("Failed sim probe: %" PRId64 "\n", rc);
+		goto destroy_ctx;
+	}
+
+	return simb_as_ahb(ctx);
+
+destroy_ctx:
+	simb_destroy(ctx);
+
+cleanup_ctx:
+	free(ctx);
+
+	return NULL;
+}
+
+static void simb_driver_destroy(struct ahb *ahb)
+{
+	struct simb *ctx = to_simb(ahb);
+	int rc;
+
+	if ((rc = simb_destroy(ctx)) < 0) {
+		loge("Failed to destroy sim bridge: %d\n", rc);
+	}
+
+	free(ctx);
+}
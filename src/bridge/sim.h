@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef _BRIDGE_SIM_H
+#define _BRIDGE_SIM_H
+
+#include "ahb.h"
+#include "simsoc.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct simb {
+	struct ahb ahb;
+	struct sim_soc soc;
+
+	/* Injected latency: op_ns per access plus byte_ns per byte */
+	uint64_t op_ns;
+	uint64_t byte_ns;
+};
+
+int simb_init(struct simb *ctx, const char *args);
+int simb_destroy(struct simb *ctx);
+
+static inline struct ahb *simb_as_ahb(struct simb *ctx)
+{
+	return &ctx->ahb;
+}
+
+ssize_t simb_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len);
+ssize_t simb_write(struct ahb *ahb, uint32_t phys, const void *buf,
+		   size_t len);
+
+int simb_readl(struct ahb *ahb, uint32_t phys, uint32_t *val);
+int simb_writel(struct ahb *ahb, uint32_t phys, uint32_t val);
+
+#endif
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ahb.h"
+#include "bridge.h"
+#include "log.h"
+#include "split.h"
+
+#include "ccan/container_of/container_of.h"
+
+#define to_splitb(ahb) container_of(ahb, struct splitb, ahb)
+
+ssize_t splitb_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len)
+{
+	return ahb_read(to_splitb(ahb)->bulk, phys, buf, len);
+}
+
+ssize_t splitb_write(struct ahb *ahb, uint32_t phys, const void *buf,
+		     size_t len)
+{
+	return ahb_write(to_splitb(ahb)->bulk, phys, buf, len);
+}
+
+int splitb_readl(struct ahb *ahb, uint32_t phys, uint32_t *val)
+{
+	return ahb_readl(to_splitb(ahb)->reg, phys, val);
+}
+
+int splitb_writel(struct ahb *ahb, uint32_t phys, uint32_t val)
+{
+	return ahb_writel(to_splitb(ahb)->reg, phys, val);
+}
+
+int splitb_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n)
+{
+	return ahb_readv(to_splitb(ahb)->reg, vec, n);
+}
+
+int splitb_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n)
+{
+	return ahb_writev(to_splitb(ahb)->reg, vec, n);
+}
+
+static int splitb_release(struct ahb *ahb)
+{
+	struct splitb *ctx = to_splitb(ahb);
+	int rc;
+
+	if ((rc = ahb_release_bridge(ctx->reg)) < 0)
+		return rc;
+
+	return ahb_release_bridge(ctx->bulk);
+}
+
+static int splitb_reinit(struct ahb *ahb)
+{
+	struct splitb *ctx = to_splitb(ahb);
+	int rc;
+
+	if ((rc = ahb_reinit_bridge(ctx->bulk)) < 0)
+		return rc;
+
+	return ahb_reinit_bridge(ctx->reg);
+}
+
+static const struct ahb_ops splitb_ahb_ops = {
+	.read = splitb_read,
+	.write = splitb_write,
+	.readl = splitb_readl,
+	.writel = splitb_writel,
+	.readv = splitb_readv,
+	.writev = splitb_writev,
+};
+
+/* Not registered: only ever assembled from already probed bridges */
+static const struct bridge_driver splitb_driver = {
+	.name = "split",
+	.release = splitb_release,
+	.reinit = splitb_reinit,
+};
+
+void splitb_init(struct splitb *ctx, struct ahb *bulk, struct ahb *reg)
+{
+	ctx->bulk = bulk;
+	ctx->reg = reg;
+
+	ahb_init_ops(&ctx->ahb, &splitb_driver, &splitb_ahb_ops);
+
+	logd("split: Bulk transfers via %s, register accesses via %s\n",
+	     bulk->drv->name, reg->drv->name);
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef _BRIDGE_SPLIT_H
+#define _BRIDGE_SPLIT_H
+
+#include "ahb.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Bulk transfers go via @bulk, register accesses via @reg */
+struct splitb {
+	struct ahb ahb;
+	struct ahb *bulk;
+	struct ahb *reg;
+};
+
+void splitb_init(struct splitb *ctx, struct ahb *bulk, struct ahb *reg);
+
+static inline struct ahb *splitb_as_ahb(struct splitb *ctx)
+{
+	return &ctx->ahb;
+}
+
+ssize_t splitb_read(struct ahb *ahb, uint32_t phys, void *buf, size_t len);
+ssize_t splitb_write(struct ahb *ahb, uint32_t phys, const void *buf,
+		     size_t len);
+
+int splitb_readl(struct ahb *ahb, uint32_t phys, uint32_t *val);
+int splitb_writel(struct ahb *ahb, uint32_t phys, uint32_t val);
+
+int splitb_readv(struct ahb *ahb, struct ahb_vec *vec, size_t n);
+int splitb_writev(struct ahb *ahb, const struct ahb_vec *vec, size_t n);
+
+#endif
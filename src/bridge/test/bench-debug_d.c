@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "bridge/debug_d.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Decode a DEBUG_D_MAX_LEN dump as debug_read() sees it, a prompt ring's worth
+ * at a time, and report the rate in MB/s of dump text.
+ */
+
+#define BENCH_LEN	(128 * 1024)
+#define BENCH_CHUNK	4096
+#define BENCH_TEXT_SIZE (BENCH_LEN * 3)
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long rounds = 200, round;
+	size_t text_len = 0, i, w;
+	struct debug_d parser;
+	uint64_t start, elapsed;
+	uint8_t *buf;
+	char *text;
+
+	if (argc > 1)
+		rounds = strtoul(argv[1], NULL, 0);
+
+	buf = malloc(BENCH_LEN);
+	text = malloc(BENCH_TEXT_SIZE);
+	if (!buf || !text)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < BENCH_LEN; i += 16) {
+		char *line = text + text_len;
+		size_t size = BENCH_TEXT_SIZE - text_len;
+		int n;
+
+		n = snprintf(line, size, "%08zx:", 0x80000000 + i);
+		for (w = 0; w < 16; w += 4)
+			n += snprintf(line + n, size - n, "%s%08zx",
+				      w ? " " : "",
+				      ((i + w) * 0x01010101) & 0xffffffff);
+		n += snprintf(line + n, size - n, "\r\n");
+
+		text_len += n;
+	}
+
+	start = bench_now_ns();
+	for (round = 0; round < rounds; round++) {
+		size_t off = 0;
+
+		debug_d_init(&parser, buf, BENCH_LEN);
+		while (parser.remaining) {
+			size_t n = text_len - off;
+			ssize_t rc;
+
+			if (n > BENCH_CHUNK)
+				n = BENCH_CHUNK;
+
+			rc = debug_d_feed(&parser, text + off, n);
+
+			if (rc <= 0) {
+				fprintf(stderr, "Failed to decode dump: %zd\n",
+					rc);
+				return EXIT_FAILURE;
+			}
+
+			off += rc;
+		}
+	}
+	elapsed = bench_now_ns() - start;
+
+	printf("Decoded %lu x %zu bytes of dump text in %.3fms: %.1f MB/s\n",
+	       rounds, text_len, elapsed / 1e6,
+	       (double)rounds * text_len * 1e3 / (elapsed ?: 1));
+
+	free(text);
+	free(buf);
+
+	return EXIT_SUCCESS;
+}
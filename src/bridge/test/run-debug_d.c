@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "array.h"
+#include "bridge/debug_d.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Drive the 'd' parser with well-formed dumps split at every point, and with
+ * malformed and random input fed in random fragments. The parser must never
+ * write outside the destination, never consume more than it was given, and
+ * only ever fail with -EBADE.
+ */
+
+#define TEST_GUARD     64
+#define TEST_GUARD_VAL 0xa5
+#define TEST_MAX_LEN   512
+#define TEST_TEXT_LEN  (64 * 1024)
+
+static uint64_t test_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t test_rand(void)
+{
+	test_state ^= test_state << 13;
+	test_state ^= test_state >> 7;
+	test_state ^= test_state << 17;
+
+	return test_state >> 32;
+}
+
+static unsigned int failures;
+
+#define check(cond, ...)                                                   \
+	do {                                                               \
+		if (!(cond)) {                                             \
+			fprintf(stderr, "%s:%d: ", __func__, __LINE__);    \
+			fprintf(stderr, __VA_ARGS__);                      \
+			fputc('\n', stderr);                               \
+			failures++;                                        \
+		}                                                          \
+	} while (0)
+
+/* Render @len bytes as the BMC's debug shell would, echoed command and all */
+static size_t test_dump(char *text, size_t size, uint32_t phys,
+			const uint8_t *data, size_t len)
+{
+	size_t off, i, w;
+
+	off = snprintf(text, size, "d %x %zx\r\n", phys, len);
+
+	for (i = 0; i < len; i += 16) {
+		off += snprintf(text + off, size - off, "%08x:",
+				phys + (uint32_t)i);
+
+		for (w = i; w < i + 16 && w < len; w += 4) {
+			uint32_t word = 0;
+			size_t b;
+
+			for (b = 0; b < 4 && w + b < len; b++)
+				word |= (uint32_t)data[w + b] << (8 * b);
+
+			off += snprintf(text + off, size - off, "%s%08x",
+					w == i ? "" : " ", word);
+		}
+
+		off += snprintf(text + off, size - off, "\r\n");
+	}
+
+	off += snprintf(text + off, size - off, "$ ");
+
+	return off;
+}
+
+static void test_guard_init(uint8_t *buf, size_t len)
+{
+	memset(buf, TEST_GUARD_VAL, TEST_GUARD);
+	memset(buf + TEST_GUARD + len, TEST_GUARD_VAL, TEST_GUARD);
+}
+
+static bool test_guard_intact(const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < TEST_GUARD; i++) {
+		if (buf[i] != TEST_GUARD_VAL ||
+		    buf[TEST_GUARD + len + i] != TEST_GUARD_VAL)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Feed @text in chunks of @chunk bytes, or random sizes if @chunk is zero,
+ * as debug_read() does. Returns the final status of the parser.
+ */
+static ssize_t test_feed(struct debug_d *parser, const char *text, size_t len,
+			 size_t chunk)
+{
+	size_t off = 0;
+	ssize_t rc;
+
+	while (parser->remaining && off < len) {
+		size_t n = chunk ?: 1 + test_rand() % 64;
+
+		if (n > len - off)
+			n = len - off;
+
+		rc = debug_d_feed(parser, text + off, n);
+		if (rc < 0) {
+			check(rc == -EBADE, "Unexpected error %zd", rc);
+			return rc;
+		}
+
+		check((size_t)rc <= n, "Consumed %zd of %zu bytes", rc, n);
+		off += rc;
+	}
+
+	return 0;
+}
+
+static void test_fragmented(void)
+{
+	static uint8_t data[TEST_MAX_LEN], buf[TEST_MAX_LEN + 2 * TEST_GUARD];
+	static char text[TEST_TEXT_LEN];
+	size_t len, text_len, chunk, i;
+	struct debug_d parser;
+	ssize_t rc;
+
+	for (len = 1; len <= 80; len++) {
+		for (i = 0; i < len; i++)
+			data[i] = test_rand();
+
+		text_len = test_dump(text, sizeof(text), 0x1e6e2000, data, len);
+
+		/* Random chunk sizes, then every size up to a whole line */
+		for (chunk = 0; chunk <= 48; chunk++) {
+			test_guard_init(buf, len);
+			debug_d_init(&parser, buf + TEST_GUARD, len);
+
+			rc = test_feed(&parser, text, text_len, chunk);
+			check(!rc, "len %zu chunk %zu failed: %zd", len, chunk,
+			      rc);
+			check(!parser.remaining,
+			      "len %zu chunk %zu left %zu bytes", len, chunk,
+			      parser.remaining);
+			check(!memcmp(buf + TEST_GUARD, data, len),
+			      "len %zu chunk %zu decoded wrongly", len, chunk);
+			check(test_guard_intact(buf, len),
+			      "len %zu chunk %zu overran the buffer", len,
+			      chunk);
+		}
+	}
+}
+
+static const struct {
+	const char *text;
+	size_t len;
+	ssize_t rc;
+} test_cases[] = {
+	/* Stray prompts and noise before the dump are skipped */
+	{ "$ \r\n$ d 0 8\r\n00000000:00000001 00000002\r\n$ ", 8, 0 },
+	{ "garbage\n\n\r\n00000000:04030201\r\n", 4, 0 },
+	/* An address without data on a line of its own */
+	{ "00000000:\r\n00000000:04030201\r\n", 4, 0 },
+	/* Short, long and non-hex words */
+	{ "00000000:0403020\r\n", 4, -EBADE },
+	{ "00000000:040302011 08070605\r\n", 8, -EBADE },
+	{ "00000000:0403zz01\r\n", 4, -EBADE },
+	{ "00000000:04030201,08070605\r\n", 8, -EBADE },
+	/* Over-long addresses aren't data */
+	{ "0000000000:04030201\r\n00000000:04030201\r\n", 4, 0 },
+};
+
+static void test_malformed(void)
+{
+	uint8_t buf[16 + 2 * TEST_GUARD];
+	struct debug_d parser;
+	size_t i, chunk;
+	ssize_t rc;
+
+	for (i = 0; i < ARRAY_SIZE(test_cases); i++) {
+		for (chunk = 1; chunk <= 8; chunk++) {
+			test_guard_init(buf, test_cases[i].len);
+			debug_d_init(&parser, buf + TEST_GUARD,
+				     test_cases[i].len);
+
+			rc = test_feed(&parser, test_cases[i].text,
+				       strlen(test_cases[i].text), chunk);
+			check(rc == test_cases[i].rc,
+			      "case %zu chunk %zu returned %zd, expected %zd",
+			      i, chunk, rc, test_cases[i].rc);
+			check(test_guard_intact(buf, test_cases[i].len),
+			      "case %zu chunk %zu overran the buffer", i,
+			      chunk);
+		}
+	}
+}
+
+/* Mostly characters the parser cares about, with arbitrary bytes mixed in */
+static char test_rand_char(void)
+{
+	static const char alphabet[] = "0123456789abcdefABCDEF:  \r\n\n$d";
+	uint32_t r = test_rand();
+
+	if (r % 8 == 0)
+		return r >> 8;
+
+	return alphabet[(r >> 8) % (sizeof(alphabet) - 1)];
+}
+
+static void test_random(unsigned long iterations)
+{
+	static uint8_t buf[TEST_MAX_LEN + 2 * TEST_GUARD];
+	static char text[TEST_TEXT_LEN];
+	static uint8_t data[TEST_MAX_LEN];
+	struct debug_d parser;
+	unsigned long iter;
+	size_t len, text_len, i;
+
+	for (iter = 0; iter < iterations; iter++) {
+		len = 1 + test_rand() % TEST_MAX_LEN;
+
+		if (iter & 1) {
+			/* Noise */
+			text_len = test_rand() % 4096;
+			for (i = 0; i < text_len; i++)
+				text[i] = test_rand_char();
+		} else {
+			/* A valid dump with a few bytes corrupted or cut */
+			for (i = 0; i < len; i++)
+				data[i] = test_rand();
+
+			text_len = test_dump(text, sizeof(text), test_rand(),
+					     data, len);
+			for (i = test_rand() % 4; i; i--)
+				text[test_rand() % text_len] =
+					test_rand_char();
+			if (test_rand() % 4 == 0)
+				text_len = test_rand() % text_len;
+		}
+
+		test_guard_init(buf, len);
+		debug_d_init(&parser, buf + TEST_GUARD, len);
+
+		test_feed(&parser, text, text_len, 0);
+
+		check(parser.cursor + parser.remaining ==
+			      buf + TEST_GUARD + len,
+		      "iteration %lu lost track of the buffer", iter);
+		check(test_guard_intact(buf, len),
+		      "iteration %lu overran the buffer", iter);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long iterations = 20000;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		test_state = strtoull(argv[2], NULL, 0) ?: test_state;
+
+	test_fragmented();
+	test_malformed();
+	test_random(iterations);
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,532 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ahb.h"
+#include "array.h"
+#include "cmd.h"
+#include "compiler.h"
+#include "connection.h"
+#include "host.h"
+#include "log.h"
+#include "soc.h"
+#include "soc/sdmc.h"
+#include "soc/trace.h"
+#include "version.h"
+
+#include <argp.h>
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+/* Don't disturb more of VRAM than we need */
+#define BENCH_VRAM_SCRATCH (1 << 20)
+
+#define BENCH_DEFAULT_SAMPLES 256
+
+/* Repeat each bulk transfer until we've spent this long on it */
+#define BENCH_BULK_BUDGET_NS (100 * 1000 * 1000ULL)
+#define BENCH_BULK_MAX_REPS  64
+
+#define BENCH_MIN_SIZE	4
+#define BENCH_MAX_SIZE	(1 << 20)
+#define BENCH_NR_SIZES	10
+#define BENCH_NR_ALIGNS 4
+
+static char cmd_bench_args_doc[] =
+	"[-f FORMAT] [-r REGION] [-n SAMPLES] "
+	"[via DRIVER [INTERFACE [IP PORT USERNAME PASSWORD]]]";
+
+static char cmd_bench_doc[] =
+	"\n"
+	"Bench command"
+	"\v"
+	"Measures readl()/writel() latency and bulk read()/write() throughput\n"
+	"for the selected bridge. The scratch region is saved beforehand and\n"
+	"restored afterwards.\n\n"
+	"Supported formats:\n"
+	"  json     A JSON object on stdout (default)\n"
+	"  csv      CSV on stdout, one row per measurement\n\n"
+	"Supported regions:\n"
+	"  sram     The AHBC trace buffer SRAM (default if available)\n"
+	"  vram     The top of VRAM\n";
+
+static struct argp_option cmd_bench_options[] = {
+	{ "format", 'f', "FORMAT", 0, "Output format", 0 },
+	{ "region", 'r', "REGION", 0, "Scratch region", 0 },
+	{ "samples", 'n', "SAMPLES", 0, "Number of latency samples", 0 },
+	{ 0 },
+};
+
+enum bench_format { bench_json, bench_csv };
+enum bench_region { bench_any, bench_sram, bench_vram };
+
+struct cmd_bench_args {
+	enum bench_format format;
+	enum bench_region region;
+	unsigned long samples;
+	struct connection_args connection;
+};
+
+struct bench_latency {
+	const char *op;
+	size_t samples;
+	uint64_t min_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+	uint64_t mean_ns;
+};
+
+struct bench_bulk {
+	const char *op;
+	uint32_t size;
+	uint32_t align;
+	unsigned int reps;
+	uint64_t ns;
+};
+
+struct bench {
+	struct ahb *ahb;
+	const char *region_name;
+	struct soc_region region;
+	struct bench_latency latency[2];
+	struct bench_bulk bulk[2 * BENCH_NR_SIZES * BENCH_NR_ALIGNS];
+	size_t nr_bulk;
+};
+
+static error_t cmd_bench_parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct cmd_bench_args *arguments = state->input;
+	char *endp;
+	int rc;
+
+	switch (key) {
+	case 'f':
+		if (!strcmp(arg, "json"))
+			arguments->format = bench_json;
+		else if (!strcmp(arg, "csv"))
+			arguments->format = bench_csv;
+		else
+			argp_error(state, "Invalid format '%s'", arg);
+		break;
+	case 'r':
+		if (!strcmp(arg, "sram"))
+			arguments->region = bench_sram;
+		else if (!strcmp(arg, "vram"))
+			arguments->region = bench_vram;
+		else
+			argp_error(state, "Invalid region '%s'", arg);
+		break;
+	case 'n':
+		arguments->samples = strtoul(arg, &endp, 0);
+		if (arg == endp || *endp || !arguments->samples)
+			argp_error(state, "Invalid sample count '%s'", arg);
+		break;
+	case ARGP_KEY_ARG:
+		if (!strcmp(arg, "via")) {
+			rc = cmd_parse_via(state->next - 1, state,
+					   &arguments->connection);
+			if (rc != 0)
+				argp_error(
+					state,
+					"Failed to parse connection arguments. Returned code %d",
+					rc);
+			state->next = state->argc;
+			break;
+		}
+
+		argp_error(state, "Unexpected argument '%s'", arg);
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp cmd_bench_argp = {
+	.options = cmd_bench_options,
+	.parser = cmd_bench_parse_opt,
+	.args_doc = cmd_bench_args_doc,
+	.doc = cmd_bench_doc,
+};
+
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench_summarise(struct bench_latency *lat, uint64_t *samples,
+			    size_t n)
+{
+	uint64_t total = 0;
+	size_t i;
+
+	qsort(samples, n, sizeof(*samples), bench_cmp_u64);
+
+	for (i = 0; i < n; i++)
+		total += samples[i];
+
+	lat->samples = n;
+	lat->min_ns = samples[0];
+	lat->p50_ns = samples[(n * 50) / 100];
+	lat->p90_ns = samples[(n * 90) / 100];
+	lat->p99_ns = samples[(n * 99) / 100];
+	lat->max_ns = samples[n - 1];
+	lat->mean_ns = total / n;
+}
+
+static int bench_latency(struct bench *ctx, size_t n)
+{
+	uint32_t phys = ctx->region.start;
+	uint64_t *samples, start;
+	uint32_t val;
+	size_t i;
+	int rc;
+
+	samples = malloc(n * sizeof(*samples));
+	if (!samples)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		start = bench_now();
+		if ((rc = ahb_readl(ctx->ahb, phys, &val)) < 0)
+			goto cleanup_samples;
+		samples[i] = bench_now() - start;
+	}
+	ctx->latency[0].op = "readl";
+	bench_summarise(&ctx->latency[0], samples, n);
+
+	for (i = 0; i < n; i++) {
+		start = bench_now();
+		if ((rc = ahb_writel(ctx->ahb, phys, i & 1 ? 0xa5a5a5a5 :
+							     0x5a5a5a5a)) < 0)
+			goto cleanup_samples;
+		samples[i] = bench_now() - start;
+	}
+	ctx->latency[1].op = "writel";
+	bench_summarise(&ctx->latency[1], samples, n);
+
+	rc = 0;
+
+cleanup_samples:
+	free(samples);
+
+	return rc;
+}
+
+static int bench_bulk_one(struct bench *ctx, bool write, uint32_t size,
+			  uint32_t align, void *buf)
+{
+	uint32_t phys = ctx->region.start + align;
+	struct bench_bulk *result;
+	uint64_t start, elapsed;
+	unsigned int reps;
+	ssize_t rc;
+
+	assert(ctx->nr_bulk < ARRAY_SIZE(ctx->bulk));
+	result = &ctx->bulk[ctx->nr_bulk];
+
+	reps = 0;
+	start = bench_now();
+	do {
+		if (write)
+			rc = ahb_write(ctx->ahb, phys, buf, size);
+		else
+			rc = ahb_read(ctx->ahb, phys, buf, size);
+		if (rc < 0)
+			return rc;
+
+		reps++;
+		elapsed = bench_now() - start;
+	} while (elapsed < BENCH_BULK_BUDGET_NS && reps < BENCH_BULK_MAX_REPS);
+
+	result->op = write ? "write" : "read";
+	result->size = size;
+	result->align = align;
+	result->reps = reps;
+	result->ns = elapsed;
+	ctx->nr_bulk++;
+
+	logd("bench: %s %" PRIu32 "@+%" PRIu32 ": %u reps in %" PRIu64
+	     "ns\n",
+	     result->op, size, align, reps, elapsed);
+
+	return 0;
+}
+
+static int bench_bulk(struct bench *ctx)
+{
+	uint32_t size, align;
+	uint8_t *buf;
+	size_t i;
+	int rc;
+
+	buf = malloc(ctx->region.length);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < ctx->region.length; i++)
+		buf[i] = i;
+
+	for (size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size <<= 2) {
+		for (align = 0; align < BENCH_NR_ALIGNS; align++) {
+			if (size + align > ctx->region.length)
+				break;
+
+			if ((rc = bench_bulk_one(ctx, false, size, align, buf)))
+				goto cleanup_buf;
+
+			if ((rc = bench_bulk_one(ctx, true, size, align, buf)))
+				goto cleanup_buf;
+		}
+	}
+
+	rc = 0;
+
+cleanup_buf:
+	free(buf);
+
+	return rc;
+}
+
+static double bench_mib_per_sec(const struct bench_bulk *bulk)
+{
+	if (!bulk->ns)
+		return 0;
+
+	return ((double)bulk->size * bulk->reps / (1 << 20)) /
+	       ((double)bulk->ns / 1000000000.0);
+}
+
+static void bench_report_json(struct bench *ctx, const char *kernel)
+{
+	size_t i;
+
+	printf("{\n");
+	printf("\t\"version\": \"%s\",\n", CULVERT_VERSION);
+	printf("\t\"kernel\": \"%s\",\n", kernel);
+	printf("\t\"bridge\": \"%s\",\n", ctx->ahb->drv->name);
+	printf("\t\"region\": { \"name\": \"%s\", \"start\": %" PRIu32
+	       ", \"length\": %" PRIu32 " },\n",
+	       ctx->region_name, ctx->region.start, ctx->region.length);
+
+	printf("\t\"latency\": [\n");
+	for (i = 0; i < ARRAY_SIZE(ctx->latency); i++) {
+		const struct bench_latency *lat = &ctx->latency[i];
+
+		printf("\t\t{ \"op\": \"%s\", \"samples\": %zu, "
+		       "\"min_ns\": %" PRIu64 ", \"p50_ns\": %" PRIu64
+		       ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+		       ", \"max_ns\": %" PRIu64 ", \"mean_ns\": %" PRIu64
+		       " }%s\n",
+		       lat->op, lat->samples, lat->min_ns, lat->p50_ns,
+		       lat->p90_ns, lat->p99_ns, lat->max_ns, lat->mean_ns,
+		       i + 1 < ARRAY_SIZE(ctx->latency) ? "," : "");
+	}
+	printf("\t],\n");
+
+	printf("\t\"bulk\": [\n");
+	for (i = 0; i < ctx->nr_bulk; i++) {
+		const struct bench_bulk *bulk = &ctx->bulk[i];
+
+		printf("\t\t{ \"op\": \"%s\", \"size\": %" PRIu32
+		       ", \"align\": %" PRIu32 ", \"reps\": %u, "
+		       "\"ns\": %" PRIu64 ", \"mib_per_sec\": %.3f }%s\n",
+		       bulk->op, bulk->size, bulk->align, bulk->reps, bulk->ns,
+		       bench_mib_per_sec(bulk),
+		       i + 1 < ctx->nr_bulk ? "," : "");
+	}
+	printf("\t]\n");
+	printf("}\n");
+}
+
+static void bench_report_csv(struct bench *ctx, const char *kernel)
+{
+	size_t i;
+
+	printf("version,kernel,bridge,region,op,size,align,samples,"
+	       "min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,mib_per_sec\n");
+
+	for (i = 0; i < ARRAY_SIZE(ctx->latency); i++) {
+		const struct bench_latency *lat = &ctx->latency[i];
+
+		printf("%s,%s,%s,%s,%s,4,0,%zu,%" PRIu64 ",%" PRIu64
+		       ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",\n",
+		       CULVERT_VERSION, kernel, ctx->ahb->drv->name,
+		       ctx->region_name, lat->op, lat->samples, lat->min_ns,
+		       lat->p50_ns, lat->p90_ns, lat->p99_ns, lat->max_ns,
+		       lat->mean_ns);
+	}
+
+	for (i = 0; i < ctx->nr_bulk; i++) {
+		const struct bench_bulk *bulk = &ctx->bulk[i];
+
+		printf("%s,%s,%s,%s,%s,%" PRIu32 ",%" PRIu32 ",%u,,,,,,%" PRIu64
+		       ",%.3f\n",
+		       CULVERT_VERSION, kernel, ctx->ahb->drv->name,
+		       ctx->region_name, bulk->op, bulk->size, bulk->align,
+		       bulk->reps, bulk->ns / bulk->reps,
+		       bench_mib_per_sec(bulk));
+	}
+}
+
+static int bench_find_region(struct bench *ctx, struct soc *soc,
+			     enum bench_region region)
+{
+	struct soc_region vram;
+	struct trace *trace;
+	struct sdmc *sdmc;
+	int rc;
+
+	if (region != bench_vram) {
+		if ((trace = trace_get(soc))) {
+			ctx->region_name = "sram";
+			return trace_get_buffer(trace, &ctx->region);
+		}
+
+		if (region == bench_sram) {
+			loge("bench: No trace buffer SRAM available\n");
+			return -ENODEV;
+		}
+	}
+
+	if (!(sdmc = sdmc_get(soc))) {
+		loge("bench: Failed to acquire SDRAM memory controller\n");
+		return -ENODEV;
+	}
+
+	if ((rc = sdmc_get_vram(sdmc, &vram)) < 0)
+		return rc;
+
+	ctx->region_name = "vram";
+	ctx->region.length = vram.length < BENCH_VRAM_SCRATCH ?
+				     vram.length :
+				     BENCH_VRAM_SCRATCH;
+	ctx->region.start = vram.start + vram.length - ctx->region.length;
+
+	return 0;
+}
+
+static int do_bench(int argc, char **argv)
+{
+	struct host _host, *host = &_host;
+	struct soc _soc, *soc = &_soc;
+	struct bench *ctx;
+	struct utsname uts;
+	void *saved;
+	ssize_t rc;
+	int cleanup;
+
+	struct cmd_bench_args arguments = { 0 };
+	arguments.samples = BENCH_DEFAULT_SAMPLES;
+	rc = argp_parse(&cmd_bench_argp, argc, argv, ARGP_IN_ORDER, 0,
+			&arguments);
+	if (rc != 0)
+		return rc;
+
+	if (uname(&uts) < 0)
+		strcpy(uts.release, "unknown");
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -ENOMEM;
+
+	if ((rc = host_init(host, &arguments.connection)) < 0) {
+		loge("Failed to initialise host interfaces: %zd\n", rc);
+		goto cleanup_ctx;
+	}
+
+	if (!(ctx->ahb = host_get_ahb(host))) {
+		loge("Failed to acquire AHB interface, exiting\n");
+		rc = -ENODEV;
+		goto cleanup_host;
+	}
+
+	if ((rc = soc_probe(soc, ctx->ahb)) < 0)
+		goto cleanup_host;
+
+	if ((rc = bench_find_region(ctx, soc, arguments.region)) < 0)
+		goto cleanup_soc;
+
+	logi("Benchmarking %s bridge using %s [0x%08" PRIx32 " - 0x%08" PRIx32
+	     "]\n",
+	     ctx->ahb->drv->name, ctx->region_name, ctx->region.start,
+	     ctx->region.start + ctx->region.length - 1);
+
+	saved = malloc(ctx->region.length);
+	if (!saved) {
+		rc = -ENOMEM;
+		goto cleanup_soc;
+	}
+
+	rc = ahb_read(ctx->ahb, ctx->region.start, saved, ctx->region.length);
+	if (rc < 0) {
+		loge("bench: Failed to save scratch region: %zd\n", rc);
+		goto cleanup_saved;
+	}
+
+	if ((rc = bench_latency(ctx, arguments.samples)) < 0) {
+		loge("bench: Latency measurement failed: %zd\n", rc);
+		goto restore_saved;
+	}
+
+	if ((rc = bench_bulk(ctx)) < 0) {
+		loge("bench: Throughput measurement failed: %zd\n", rc);
+		goto restore_saved;
+	}
+
+	if (arguments.format == bench_csv)
+		bench_report_csv(ctx, uts.release);
+	else
+		bench_report_json(ctx, uts.release);
+
+restore_saved:
+	cleanup = ahb_write(ctx->ahb, ctx->region.start, saved,
+			    ctx->region.length);
+	if (cleanup < 0) {
+		loge("bench: Failed to restore scratch region: %d\n", cleanup);
+		if (!rc)
+			rc = cleanup;
+	}
+
+cleanup_saved:
+	free(saved);
+
+cleanup_soc:
+	soc_destroy(soc);
+
+cleanup_host:
+	host_destroy(host);
+
+cleanup_ctx:
+	free(ctx);
+
+	return rc;
+}
+
+static const struct cmd bench_cmd = {
+	.name = "bench",
+	.description = "Measure bridge latency and throughput",
+	.fn = do_bench,
+};
+REGISTER_CMD(bench_cmd);
@@ -0,0 +1,747 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ahb.h"
+#include "bridge.h"
+#include "bridge/record.h"
+#include "cmd.h"
+#include "compiler.h"
+#include "connection.h"
+#include "host.h"
+#include "log.h"
+#include "rev.h"
+#include "soc.h"
+
+#include "ccan/container_of/container_of.h"
+
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REPLAY_HOT_ADDRESSES 16
+#define REPLAY_MAX_VEC	     256
+#define REPLAY_PAGE_SHIFT    12
+
+static char cmd_replay_args_doc[] =
+	"<stat|run> LOG [via DRIVER [INTERFACE [IP PORT USERNAME PASSWORD]]]";
+
+static char cmd_replay_doc[] =
+	"\n"
+	"Replay command"
+	"\v"
+	"Analyse or replay a log captured with 'culvert --record=LOG ...'\n\n"
+	"Supported modes:\n"
+	"  stat    Summarise time spent per operation and SoC device, the\n"
+	"          hottest registers and the locality of the accesses\n"
+	"  run     Re-issue the recorded accesses through a bridge. Bulk\n"
+	"          payloads are not recorded, so bulk writes are skipped.\n"
+	"          Only the sim bridge is used unless --force is given\n";
+
+static struct argp_option cmd_replay_options[] = {
+	{ "force", 'f', 0, 0, "Allow replay through a bridge to real hardware",
+	  0 },
+	{ 0 },
+};
+
+enum cmd_replay_mode {
+	mode_none,
+	mode_stat,
+	mode_run,
+};
+
+struct cmd_replay_args {
+	enum cmd_replay_mode mode;
+	const char *log;
+	struct connection_args connection;
+	bool force;
+};
+
+static error_t cmd_replay_parse_opt(int key, char *arg,
+				    struct argp_state *state)
+{
+	struct cmd_replay_args *arguments = state->input;
+	int rc;
+
+	switch (key) {
+	case 'f':
+		arguments->force = true;
+		break;
+	case ARGP_KEY_ARG:
+		if (!strcmp(arg, "via")) {
+			rc = cmd_parse_via(state->next - 1, state,
+					   &arguments->connection);
+			if (rc != 0)
+				argp_error(
+					state,
+					"Failed to parse connection arguments. Returned code %d",
+					rc);
+			state->next = state->argc;
+			break;
+		}
+
+		if (state->arg_num == 0) {
+			if (!strcmp(arg, "stat"))
+				arguments->mode = mode_stat;
+			else if (!strcmp(arg, "run"))
+				arguments->mode = mode_run;
+			else
+				argp_error(state, "Invalid mode '%s'", arg);
+		} else if (state->arg_num == 1) {
+			arguments->log = arg;
+		} else {
+			argp_usage(state);
+		}
+		break;
+	case ARGP_KEY_END:
+		if (!arguments->log)
+			argp_usage(state);
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp cmd_replay_argp = {
+	.options = cmd_replay_options,
+	.parser = cmd_replay_parse_opt,
+	.args_doc = cmd_replay_args_doc,
+	.doc = cmd_replay_doc,
+};
+
+struct replay_log {
+	void *map;
+	size_t size;
+	const struct recb_entry *entries;
+	size_t n;
+};
+
+static int replay_log_open(struct replay_log *log, const char *path)
+{
+	const struct recb_header *header;
+	struct stat statbuf;
+	int fd, rc;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		rc = -errno;
+		loge("replay: Failed to open '%s': %d\n", path, rc);
+		return rc;
+	}
+
+	if (fstat(fd, &statbuf) < 0) {
+		rc = -errno;
+		goto cleanup_fd;
+	}
+
+	log->size = statbuf.st_size;
+	if (log->size < sizeof(*header)) {
+		loge("replay: '%s' is too short to be a recording\n", path);
+		rc = -EINVAL;
+		goto cleanup_fd;
+	}
+
+	log->map = mmap(NULL, log->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (log->map == MAP_FAILED) {
+		rc = -errno;
+		goto cleanup_fd;
+	}
+
+	header = log->map;
+	if (memcmp(header->magic, RECB_MAGIC, sizeof(RECB_MAGIC)) ||
+	    header->version != RECB_VERSION ||
+	    header->entry_size != sizeof(struct recb_entry)) {
+		loge("replay: '%s' is not a compatible recording\n", path);
+		rc = -EINVAL;
+		goto cleanup_map;
+	}
+
+	log->entries = (const void *)(header + 1);
+	log->n = (log->size - sizeof(*header)) / sizeof(struct recb_entry);
+
+	close(fd);
+
+	return 0;
+
+cleanup_map:
+	munmap(log->map, log->size);
+
+cleanup_fd:
+	close(fd);
+
+	return rc;
+}
+
+static void replay_log_close(struct replay_log *log)
+{
+	munmap(log->map, log->size);
+}
+
+/*
+ * Serves register reads from the recording so rev_probe() can identify the SoC
+ * the log was captured from.
+ */
+struct replay_ahb {
+	struct ahb ahb;
+	const struct replay_log *log;
+};
+
+#define to_replay_ahb(ahb) container_of(ahb, struct replay_ahb, ahb)
+
+static ssize_t replay_ahb_read(struct ahb *ahb __unused, uint32_t phys __unused,
+			       void *buf __unused, size_t len __unused)
+{
+	return -ENOTSUP;
+}
+
+static ssize_t replay_ahb_write(struct ahb *ahb __unused,
+				uint32_t phys __unused,
+				const void *buf __unused, size_t len __unused)
+{
+	return -ENOTSUP;
+}
+
+static int replay_ahb_readl(struct ahb *ahb, uint32_t phys, uint32_t *val)
+{
+	const struct replay_log *log = to_replay_ahb(ahb)->log;
+	size_t i;
+
+	for (i = 0; i < log->n; i++) {
+		const struct recb_entry *entry = &log->entries[i];
+
+		if (entry->phys != phys || entry->width != 4 || entry->err)
+			continue;
+
+		if (entry->op == ahb_op_readl || entry->op == ahb_op_readv) {
+			*val = entry->val;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+static int replay_ahb_writel(struct ahb *ahb __unused, uint32_t phys __unused,
+			     uint32_t val __unused)
+{
+	return -ENOTSUP;
+}
+
+static const struct ahb_ops replay_ahb_ops = {
+	.read = replay_ahb_read,
+	.write = replay_ahb_write,
+	.readl = replay_ahb_readl,
+	.writel = replay_ahb_writel,
+};
+
+static const struct bridge_driver replay_driver = {
+	.name = "replay",
+};
+
+struct replay_account {
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t ns;
+};
+
+static void replay_account(struct replay_account *acct,
+			   const struct recb_entry *entry)
+{
+	acct->count++;
+	acct->bytes += entry->err ? 0 : entry->len;
+	acct->ns += entry->duration_ns;
+}
+
+static int replay_find_region(const struct soc_device_region *regions,
+			      size_t n_regions, uint32_t phys)
+{
+	uint32_t best_len = UINT32_MAX;
+	int best = -1;
+	size_t i;
+
+	for (i = 0; i < n_regions; i++) {
+		const struct soc_region *region = &regions[i].region;
+
+		if (phys < region->start || phys - region->start >= region->length)
+			continue;
+
+		if (region->length < best_len) {
+			best_len = region->length;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+struct replay_hot {
+	uint32_t phys;
+	uint64_t count;
+};
+
+static int replay_cmp_phys(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int replay_cmp_hot(const void *a, const void *b)
+{
+	const struct replay_hot *x = a;
+	const struct replay_hot *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+
+	return (x->phys > y->phys) - (x->phys < y->phys);
+}
+
+struct replay_device {
+	const char *name;
+	struct replay_account acct;
+};
+
+static int replay_cmp_device(const void *a, const void *b)
+{
+	const struct replay_device *x = a;
+	const struct replay_device *y = b;
+
+	return (x->acct.ns < y->acct.ns) - (x->acct.ns > y->acct.ns);
+}
+
+static void replay_print_account(const char *name,
+				 const struct replay_account *acct,
+				 uint64_t total_ns)
+{
+	printf("  %-28s %10" PRIu64 " %14" PRIu64 " %12.3f %6.1f%%\n", name,
+	       acct->count, acct->bytes, acct->ns / 1e6,
+	       total_ns ? 100.0 * acct->ns / total_ns : 0.0);
+}
+
+static int replay_stat_hot(const struct replay_log *log,
+			   const struct soc_device_region *regions,
+			   size_t n_regions)
+{
+	struct replay_hot *hot;
+	uint32_t *addrs;
+	size_t i, n, n_hot;
+	int region;
+
+	addrs = malloc(log->n * sizeof(*addrs));
+	if (!addrs)
+		return -ENOMEM;
+
+	for (i = 0, n = 0; i < log->n; i++) {
+		if (log->entries[i].width)
+			addrs[n++] = log->entries[i].phys;
+	}
+
+	if (!n) {
+		free(addrs);
+		return 0;
+	}
+
+	qsort(addrs, n, sizeof(*addrs), replay_cmp_phys);
+
+	hot = malloc(n * sizeof(*hot));
+	if (!hot) {
+		free(addrs);
+		return -ENOMEM;
+	}
+
+	for (i = 0, n_hot = 0; i < n; i++) {
+		if (n_hot && hot[n_hot - 1].phys == addrs[i]) {
+			hot[n_hot - 1].count++;
+			continue;
+		}
+
+		hot[n_hot].phys = addrs[i];
+		hot[n_hot].count = 1;
+		n_hot++;
+	}
+
+	qsort(hot, n_hot, sizeof(*hot), replay_cmp_hot);
+
+	printf("\nHottest registers:\n");
+	for (i = 0; i < n_hot && i < REPLAY_HOT_ADDRESSES; i++) {
+		region = replay_find_region(regions, n_regions, hot[i].phys);
+		printf("  0x%08" PRIx32 " %10" PRIu64 "  %s\n", hot[i].phys,
+		       hot[i].count, region < 0 ? "?" : regions[region].name);
+	}
+
+	free(hot);
+	free(addrs);
+
+	return 0;
+}
+
+static void replay_stat_locality(const struct replay_log *log)
+{
+	uint64_t sequential = 0, same_page = 0, repeated = 0;
+	const struct recb_entry *prev = NULL;
+	size_t i;
+
+	for (i = 0; i < log->n; i++) {
+		const struct recb_entry *entry = &log->entries[i];
+
+		if (prev) {
+			if (entry->phys == prev->phys)
+				repeated++;
+			else if (entry->phys == prev->phys + prev->len)
+				sequential++;
+
+			if ((entry->phys >> REPLAY_PAGE_SHIFT) ==
+			    (prev->phys >> REPLAY_PAGE_SHIFT))
+				same_page++;
+		}
+
+		prev = entry;
+	}
+
+	if (log->n < 2)
+		return;
+
+	printf("\nLocality (relative to the previous access):\n");
+	printf("  Same address:  %6.1f%%\n",
+	       100.0 * repeated / (log->n - 1));
+	printf("  Sequential:    %6.1f%%\n",
+	       100.0 * sequential / (log->n - 1));
+	printf("  Same 4K page:  %6.1f%%\n",
+	       100.0 * same_page / (log->n - 1));
+}
+
+static int replay_soc_regions(const struct replay_log *log,
+			      struct soc_device_region **regions,
+			      size_t *n_regions)
+{
+	struct replay_ahb replay = { .log = log };
+	struct soc _soc, *soc = &_soc;
+	int64_t rev;
+	size_t i;
+	int rc;
+
+	ahb_init_ops(&replay.ahb, &replay_driver, &replay_ahb_ops);
+
+	if ((rev = rev_probe(&replay.ahb)) < 0) {
+		logi("Unable to identify the SoC from the recording\n");
+		return rev;
+	}
+
+	if ((rc = soc_from_rev(soc, &replay.ahb, rev)) < 0)
+		return rc;
+
+	if ((rc = soc_device_get_regions(soc, regions, n_regions)) < 0)
+		goto cleanup_soc;
+
+	/* Names point into the devicetree, which goes away with the soc */
+	for (i = 0; i < *n_regions; i++) {
+		(*regions)[i].name = strdup((*regions)[i].name);
+		if (!(*regions)[i].name) {
+			while (i--)
+				free((void *)(*regions)[i].name);
+			free(*regions);
+			rc = -ENOMEM;
+			goto cleanup_soc;
+		}
+	}
+
+	printf("SoC: %s\n", rev_name(rev));
+
+cleanup_soc:
+	soc_destroy(soc);
+
+	return rc;
+}
+
+static int replay_stat(const struct replay_log *log)
+{
+	struct replay_account ops[ahb_op_max] = { 0 };
+	struct soc_device_region *regions = NULL;
+	struct replay_device *devices;
+	uint64_t busy = 0, span = 0;
+	size_t n_regions = 0, i;
+	int region;
+	int rc;
+
+	/* Device attribution is best-effort */
+	if (replay_soc_regions(log, &regions, &n_regions) < 0) {
+		regions = NULL;
+		n_regions = 0;
+	}
+
+	/* The final slot accounts for accesses outside any known device */
+	devices = calloc(n_regions + 1, sizeof(*devices));
+	if (!devices) {
+		rc = -ENOMEM;
+		goto cleanup_regions;
+	}
+
+	for (i = 0; i < n_regions; i++)
+		devices[i].name = regions[i].name;
+	devices[n_regions].name = "(unknown)";
+
+	for (i = 0; i < log->n; i++) {
+		const struct recb_entry *entry = &log->entries[i];
+
+		if (entry->op < ahb_op_max)
+			replay_account(&ops[entry->op], entry);
+
+		region = replay_find_region(regions, n_regions, entry->phys);
+		replay_account(
+			&devices[region < 0 ? n_regions : (size_t)region].acct,
+			entry);
+
+		busy += entry->duration_ns;
+		if (entry->ts_ns + entry->duration_ns > span)
+			span = entry->ts_ns + entry->duration_ns;
+	}
+
+	printf("Accesses: %zu\n", log->n);
+	printf("Duration: %.3fms\n", span / 1e6);
+	printf("Bridge time: %.3fms (%.1f%%)\n", busy / 1e6,
+	       span ? 100.0 * busy / span : 0.0);
+
+	printf("\n  %-28s %10s %14s %12s %7s\n", "operation", "count", "bytes",
+	       "time (ms)", "time");
+	for (i = 0; i < ahb_op_max; i++) {
+		if (ops[i].count)
+			replay_print_account(ahb_op_name(i), &ops[i], busy);
+	}
+
+	printf("\n  %-28s %10s %14s %12s %7s\n", "device", "count", "bytes",
+	       "time (ms)", "time");
+	qsort(devices, n_regions + 1, sizeof(*devices), replay_cmp_device);
+	for (i = 0; i < n_regions + 1; i++) {
+		if (devices[i].acct.count)
+			replay_print_account(devices[i].name, &devices[i].acct,
+					     busy);
+	}
+
+	if ((rc = replay_stat_hot(log, regions, n_regions)) < 0)
+		goto cleanup_devices;
+
+	replay_stat_locality(log);
+
+	rc = 0;
+
+cleanup_devices:
+	free(devices);
+
+cleanup_regions:
+	for (i = 0; i < n_regions; i++)
+		free((void *)regions[i].name);
+	free(regions);
+
+	return rc;
+}
+
+static int replay_vec(struct ahb *ahb, const struct replay_log *log, size_t *i,
+		      uint64_t *divergences)
+{
+	const struct recb_entry *first = &log->entries[*i];
+	struct ahb_vec vec[REPLAY_MAX_VEC];
+	size_t n, j;
+	int rc;
+
+	/* Elements of a single transaction share an op and timestamp */
+	for (n = 0; n < REPLAY_MAX_VEC && *i + n < log->n; n++) {
+		const struct recb_entry *entry = &log->entries[*i + n];
+
+		if (entry->op != first->op || entry->ts_ns != first->ts_ns)
+			break;
+
+		vec[n].phys = entry->phys;
+		vec[n].width = entry->width;
+		vec[n].val = entry->val & 0xffffffff;
+		vec[n].mask = entry->val >> 32;
+	}
+
+	if (first->op == ahb_op_readv) {
+		if ((rc = ahb_readv(ahb, vec, n)) < 0)
+			return rc;
+
+		for (j = 0; j < n; j++) {
+			if ((log->entries[*i + j].val & 0xffffffff) != vec[j].val)
+				(*divergences)++;
+		}
+	} else {
+		if ((rc = ahb_writev(ahb, vec, n)) < 0)
+			return rc;
+	}
+
+	*i += n;
+
+	return 0;
+}
+
+static int replay_run(const struct replay_log *log,
+		      struct connection_args *connection, bool force)
+{
+	struct host _host, *host = &_host;
+	uint64_t divergences = 0, skipped = 0, dropped = 0, recorded = 0;
+	uint64_t start, elapsed;
+	size_t buf_len = 0;
+	void *buf = NULL;
+	struct ahb *ahb;
+	uint32_t val;
+	size_t i;
+	int rc;
+
+	if ((rc = host_init(host, connection)) < 0) {
+		loge("Failed to initialise host interfaces: %d\n", rc);
+		return rc;
+	}
+
+	if (!(ahb = host_get_ahb(host))) {
+		loge("Failed to acquire AHB interface, exiting\n");
+		rc = -ENODEV;
+		goto cleanup_host;
+	}
+
+	/*
+	 * Recordings of flash or RAM loads re-issue SFC commands and register
+	 * writes verbatim, which is only safe against the simulated SoC
+	 */
+	if (strcmp(ahb->drv->name, "sim") && !force) {
+		loge("replay: Refusing to replay via %s, use the sim bridge or pass --force\n",
+		     ahb->drv->name);
+		rc = -EPERM;
+		goto cleanup_host;
+	}
+
+	start = ahb_stats_now();
+	for (i = 0; i < log->n;) {
+		const struct recb_entry *entry = &log->entries[i];
+		size_t first = i;
+
+		/* Accesses that failed during recording may well fail again */
+		if (entry->err) {
+			recorded += entry->duration_ns;
+			skipped++;
+			i++;
+			continue;
+		}
+
+		if (entry->len > buf_len) {
+			void *tmp = realloc(buf, entry->len);
+
+			if (!tmp) {
+				rc = -ENOMEM;
+				goto cleanup_buf;
+			}
+
+			buf = tmp;
+			buf_len = entry->len;
+		}
+
+		switch (entry->op) {
+		case ahb_op_read:
+			rc = ahb_read(ahb, entry->phys, buf, entry->len);
+			if (rc >= 0 && recb_hash(buf, rc) != entry->val)
+				divergences++;
+			break;
+		case ahb_op_write:
+			/* The payload wasn't recorded, so don't invent one */
+			dropped++;
+			rc = 0;
+			break;
+		case ahb_op_readl:
+			rc = ahb_readl(ahb, entry->phys, &val);
+			if (!rc && val != entry->val)
+				divergences++;
+			break;
+		case ahb_op_writel:
+			rc = ahb_writel(ahb, entry->phys, entry->val);
+			break;
+		case ahb_op_readv:
+		case ahb_op_writev:
+			/* Consumes the remaining elements of the transaction */
+			if ((rc = replay_vec(ahb, log, &i, &divergences)) < 0)
+				goto report_failure;
+
+			/* Each element carries its share of the transaction */
+			for (; first < i; first++)
+				recorded += log->entries[first].duration_ns;
+			continue;
+		default:
+			loge("replay: Unrecognised operation %u at entry %zu\n",
+			     entry->op, i);
+			rc = -EINVAL;
+			goto cleanup_buf;
+		}
+
+		if (rc < 0)
+			goto report_failure;
+
+		recorded += entry->duration_ns;
+		i++;
+	}
+	elapsed = ahb_stats_now() - start;
+
+	printf("Replayed %zu accesses via %s in %.3fms (recorded bridge time %.3fms)\n",
+	       log->n - skipped - dropped, ahb->drv->name, elapsed / 1e6,
+	       recorded / 1e6);
+	if (skipped)
+		printf("Skipped %" PRIu64 " accesses that failed when recorded\n",
+		       skipped);
+	if (dropped)
+		printf("Skipped %" PRIu64 " bulk writes without recorded payloads\n",
+		       dropped);
+	if (divergences)
+		printf("%" PRIu64 " reads returned different data to the recording\n",
+		       divergences);
+
+	rc = 0;
+	goto cleanup_buf;
+
+report_failure:
+	loge("replay: Access failed at entry %zu: %d\n", i, rc);
+
+cleanup_buf:
+	free(buf);
+
+cleanup_host:
+	host_destroy(host);
+
+	return rc;
+}
+
+static int do_replay(int argc, char **argv)
+{
+	struct cmd_replay_args arguments = { 0 };
+	struct replay_log log;
+	int rc;
+
+	rc = argp_parse(&cmd_replay_argp, argc, argv, ARGP_IN_ORDER, 0,
+			&arguments);
+	if (rc != 0)
+		return rc;
+
+	if ((rc = replay_log_open(&log, arguments.log)) < 0)
+		return rc;
+
+	if (arguments.mode == mode_stat)
+		rc = replay_stat(&log);
+	else
+		rc = replay_run(&log, &arguments.connection, arguments.force);
+
+	replay_log_close(&log);
+
+	return rc;
+}
+
+static const struct cmd replay_cmd = {
+	.name = "replay",
+	.description = "Analyse or replay a recording of bridge accesses",
+	.fn = do_replay,
+};
+REGISTER_CMD(replay_cmd);
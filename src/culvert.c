@@ -12,6 +12,10 @@
 #include "version.h"
 #include "ahb.h"
 #include "host.h"
+#include "lpc.h"
+#include "mmio.h"
+#include "sio.h"
+#include "soc.h"
 
 #include "ccan/autodata/autodata.h"
 
@@ -38,6 +42,20 @@ static struct argp_option root_options[] = {
 	{ "quiet", 'q', 0, 0, "Don't produce any output", 0 },
 	{ "skip-bridge", 's', "BRIDGE", 0, "Skip BRIDGE driver", 0 },
 	{ "list-bridges", 'l', 0, 0, "List available bridge drivers", 0 },
+	{ "stats", 'S', 0, 0, "Print bridge access statistics on exit", 0 },
+	{ "record", 'r', "FILE", 0, "Record bridge accesses to FILE", 0 },
+	{ "register-bridge", 'R', "BRIDGE", 0,
+	  "Use BRIDGE for register accesses and the fastest bridge for bulk transfers",
+	  0 },
+	{ "lpc", 'L', "BACKEND", 0,
+	  "Issue LPC cycles via BACKEND[:ARGS] ('help' to list)", 0 },
+	{ "mmio-width", 'W', "BYTES", 0,
+	  "Move bulk data through MMIO windows BYTES at a time (1 to 32)", 0 },
+	{ "sio-state", 'I', "FILE", OPTION_ARG_OPTIONAL,
+	  "Remember where the SuperIO was found in FILE (default /run/culvert/sio)",
+	  0 },
+	{ "cache-registers", 'C', 0, 0,
+	  "Cache SCU and LPC routing registers, if the BMC won't change them", 0 },
 	{ 0 }
 };
 
@@ -88,6 +106,56 @@ static error_t parse_root_opt(int key, char *arg, struct argp_state *state)
 		/* Early exit as we only print the bridge drivers */
 		exit(EXIT_SUCCESS);
 		break;
+	case 'S':
+		ahb_stats_enabled = true;
+		break;
+	case 'r':
+		host_set_record_path(arg);
+		break;
+	case 'R': {
+		struct bridge_driver *driver;
+
+		if (get_bridge_driver(arg, &driver)) {
+			fprintf(stderr,
+				"Error: '%s' not a recognized bridge name (use '-l' to list)\n",
+				arg);
+			return -EINVAL;
+		}
+		host_set_register_bridge(arg);
+		break;
+	}
+	case 'L':
+		if (!strcmp(arg, "help")) {
+			print_lpc_backends();
+			exit(EXIT_SUCCESS);
+		}
+
+		if (lpc_set_backend(arg)) {
+			fprintf(stderr,
+				"Error: '%s' not a recognized LPC backend (use '-L help' to list)\n",
+				arg);
+			return -EINVAL;
+		}
+		break;
+	case 'W': {
+		char *end;
+		unsigned long width;
+
+		width = strtoul(arg, &end, 0);
+		if (*end || !width || width > 32 || mmio_set_width(width)) {
+			fprintf(stderr,
+				"Error: '%s' is not a power of two from 1 to 32\n",
+				arg);
+			return -EINVAL;
+		}
+		break;
+	}
+	case 'I':
+		sio_set_state_path(arg);
+		break;
+	case 'C':
+		soc_set_caching(true);
+		break;
 	case ARGP_KEY_ARG:
 		/* Ensure that only the first argument is being used as name */
 		if (!arguments->name)
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: Apache-2.0
 // Copyright (C) 2022 IBM Corp.
 
+#define _GNU_SOURCE
 #include "ahb.h"
 #include "bridge.h"
 #include "bridge/debug.h"
@@ -8,6 +9,8 @@
 #include "bridge/ilpc.h"
 #include "bridge/l2a.h"
 #include "bridge/p2a.h"
+#include "bridge/record.h"
+#include "bridge/split.h"
 #include "connection.h"
 #include "compiler.h"
 #include "host.h"
@@ -16,6 +19,16 @@
 #include "ccan/autodata/autodata.h"
 
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
 
 struct bridge {
 	struct list_node entry;
@@ -23,6 +36,19 @@ struct bridge {
 	struct ahb *ahb;
 };
 
+static const char *host_record_path;
+static const char *host_register_bridge;
+
+void host_set_record_path(const char *path)
+{
+	host_record_path = path;
+}
+
+void host_set_register_bridge(const char *name)
+{
+	host_register_bridge = name;
+}
+
 void print_bridge_drivers(void)
 {
 	struct bridge_driver **bridges;
@@ -83,12 +109,29 @@ out:
 	return ret;
 }
 
+static int host_add_bridge(struct host *ctx, struct bridge_driver *driver,
+			   struct ahb *ahb)
+{
+	struct bridge *bridge;
+
+	bridge = malloc(sizeof(*bridge));
+	if (!bridge) {
+		driver->destroy(ahb);
+		return -ENOMEM;
+	}
+
+	bridge->driver = driver;
+	bridge->ahb = ahb;
+
+	list_add(&ctx->bridges, &bridge->entry);
+	return 0;
+}
+
 static inline int host_probe_bridge(struct host *ctx,
 				    struct bridge_driver *driver,
 				    struct connection_args *connection)
 {
 	struct ahb *ahb;
-	struct bridge *bridge;
 
 	if (driver->disabled) {
 		logd("Skipping bridge driver %s\n", driver->name);
@@ -101,25 +144,332 @@ static inline int host_probe_bridge(struct host *ctx,
 	if (!ahb)
 		return 0;
 
-	bridge = malloc(sizeof(*bridge));
-	if (!bridge)
+	return host_add_bridge(ctx, driver, ahb);
+}
+
+/*
+ * Bridges at least this cheap end probing early: the remaining candidates
+ * can't improve on them by enough to be worth waiting for.
+ */
+#define HOST_PROBE_FAST_COST (100 * 1000)
+
+/* How long to wait on a driver that doesn't specify its own probe timeout */
+#define HOST_PROBE_TIMEOUT_MS 5000
+
+/*
+ * Abandoning a probe signals its eventfd, which stops the driver at its next
+ * step or wakes it from a wait on the device. Whatever the driver had already
+ * done to the BMC stands, and it may still complete the step it's in:
+ *
+ * - debug-uart may have sent the password at 1200 baud, leaving the BMC in its
+ *   debug shell. If the probe completes regardless, the bridge is destroyed,
+ *   which exits the shell again. A TS16 port may be left in binary mode.
+ * - p2a may have unlocked the P2A registers, which destroying the bridge
+ *   relocks. Its MMIO accesses aren't interruptible.
+ *
+ * Steps that can't be interrupted, such as a connect() to an unresponsive
+ * console server, run on until the probe's deadline. Past it, the thread is
+ * left to finish alone and the process may exit partway through the step.
+ */
+enum host_probe_state {
+	probe_running,
+	probe_done,
+	probe_abandoned,
+};
+
+struct host_probe {
+	struct list_node entry;
+	struct host *host;
+	struct bridge_driver *driver;
+	struct connection_args connection;
+	pthread_t thread;
+	uint64_t deadline;
+	int cancel_fd;
+	/* Held by the host and the thread, the last put frees the probe */
+	unsigned int refs;
+
+	/* Moves from running exactly once, by atomic exchange */
+	enum host_probe_state state;
+	/* Valid once the state is done */
+	struct ahb *ahb;
+};
+
+static __thread int host_probe_cancel_fd = -1;
+
+int bridge_probe_cancel_fd(void)
+{
+	return host_probe_cancel_fd;
+}
+
+bool bridge_probe_cancelled(void)
+{
+	struct pollfd fd = { .fd = host_probe_cancel_fd, .events = POLLIN };
+
+	if (host_probe_cancel_fd < 0)
+		return false;
+
+	return poll(&fd, 1, 0) > 0;
+}
+
+static void host_probe_put(struct host_probe *probe)
+{
+	if (__atomic_sub_fetch(&probe->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	close(probe->cancel_fd);
+	free(probe);
+}
+
+static bool host_probe_finish(struct host_probe *probe,
+			      enum host_probe_state state)
+{
+	enum host_probe_state running = probe_running;
+
+	return __atomic_compare_exchange_n(&probe->state, &running, state,
+					   false, __ATOMIC_ACQ_REL,
+					   __ATOMIC_ACQUIRE);
+}
+
+static bool host_probe_abandon(struct host_probe *probe)
+{
+	uint64_t one = 1;
+
+	if (!host_probe_finish(probe, probe_abandoned))
+		return false;
+
+	if (write(probe->cancel_fd, &one, sizeof(one)) < 0)
+		logd("Failed to cancel the %s probe: %d\n", probe->driver->name,
+		     -errno);
+
+	return true;
+}
+
+static uint64_t host_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *host_probe_thread(void *arg)
+{
+	struct host_probe *probe = arg;
+	struct host *ctx = probe->host;
+	struct ahb *ahb;
+
+	host_probe_cancel_fd = probe->cancel_fd;
+	ahb = probe->driver->probe(&probe->connection);
+	host_probe_cancel_fd = -1;
+
+	probe->ahb = ahb;
+	if (host_probe_finish(probe, probe_done)) {
+		/* The host joins us before it goes away */
+		pthread_mutex_lock(&ctx->lock);
+		if (ahb && probe->driver->caps.cost &&
+		    probe->driver->caps.cost <= HOST_PROBE_FAST_COST)
+			ctx->fast = true;
+		pthread_cond_broadcast(&ctx->cond);
+		pthread_mutex_unlock(&ctx->lock);
+	} else if (ahb) {
+		/*
+		 * Nobody is waiting for the result any more, and the host may
+		 * be gone, so tidy up after ourselves
+		 */
+		logd("Discarding late %s bridge\n", probe->driver->name);
+		probe->driver->destroy(ahb);
+	}
+
+	host_probe_put(probe);
+
+	return NULL;
+}
+
+static int host_probe_start(struct host *ctx, struct bridge_driver *driver,
+			    struct connection_args *connection)
+{
+	struct host_probe *probe;
+	unsigned int timeout;
+	int rc;
+
+	if (!(probe = malloc(sizeof(*probe))))
 		return -ENOMEM;
 
-	bridge->driver = driver;
-	bridge->ahb = ahb;
+	if ((probe->cancel_fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+		rc = -errno;
+		free(probe);
+		return rc;
+	}
+
+	timeout = driver->probe_timeout_ms ?: HOST_PROBE_TIMEOUT_MS;
+
+	probe->host = ctx;
+	probe->driver = driver;
+	probe->connection = *connection;
+	probe->deadline = host_now_ns() + timeout * 1000000ULL;
+	probe->refs = 2;
+	probe->state = probe_running;
+	probe->ahb = NULL;
+
+	logd("Trying bridge driver %s\n", driver->name);
+
+	if ((rc = -pthread_create(&probe->thread, NULL, host_probe_thread,
+				  probe))) {
+		close(probe->cancel_fd);
+		free(probe);
+		return rc;
+	}
+
+	list_add_tail(&ctx->probes, &probe->entry);
 
-	list_add(&ctx->bridges, &bridge->entry);
 	return 0;
 }
 
+/* Wait until every probe has answered, expired, or been beaten */
+static void host_probe_wait(struct host *ctx, bool cancel)
+{
+	struct host_probe *probe;
+	struct timespec ts;
+	uint64_t now, next;
+	bool pending;
+
+	pthread_mutex_lock(&ctx->lock);
+	for (;;) {
+		now = host_now_ns();
+		next = UINT64_MAX;
+		pending = false;
+
+		list_for_each(&ctx->probes, probe, entry) {
+			if (__atomic_load_n(&probe->state, __ATOMIC_ACQUIRE) !=
+			    probe_running)
+				continue;
+
+			if (cancel && ctx->fast) {
+				if (host_probe_abandon(probe))
+					logd("Abandoning %s probe, found a fast bridge\n",
+					     probe->driver->name);
+			} else if (now >= probe->deadline) {
+				if (host_probe_abandon(probe))
+					logi("Timed out probing the %s bridge\n",
+					     probe->driver->name);
+			} else {
+				pending = true;
+				if (probe->deadline < next)
+					next = probe->deadline;
+			}
+		}
+
+		if (!pending)
+			break;
+
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		pthread_cond_timedwait(&ctx->cond, &ctx->lock, &ts);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/* Take the bridges of answered probes, leaving the abandoned to be reaped */
+static int host_probe_collect(struct host *ctx)
+{
+	struct host_probe *probe, *next;
+	int rc = 0;
+
+	list_for_each_safe(&ctx->probes, probe, next, entry) {
+		if (__atomic_load_n(&probe->state, __ATOMIC_ACQUIRE) !=
+		    probe_done)
+			continue;
+
+		pthread_join(probe->thread, NULL);
+
+		if (probe->ahb) {
+			if (host_add_bridge(ctx, probe->driver, probe->ahb) < 0)
+				rc = -ENOMEM;
+		}
+
+		list_del(&probe->entry);
+		host_probe_put(probe);
+	}
+
+	return rc;
+}
+
+/* Join the probe's thread if it exits before the probe's deadline */
+static int host_probe_join(struct host_probe *probe)
+{
+	uint64_t now = host_now_ns(), left;
+	struct timespec ts;
+
+	if (now >= probe->deadline)
+		return pthread_tryjoin_np(probe->thread, NULL);
+
+	/* pthread_timedjoin_np() only measures against CLOCK_REALTIME */
+	clock_gettime(CLOCK_REALTIME, &ts);
+	left = probe->deadline - now + ts.tv_nsec;
+	ts.tv_sec += left / 1000000000ULL;
+	ts.tv_nsec = left % 1000000000ULL;
+
+	return pthread_timedjoin_np(probe->thread, NULL, &ts);
+}
+
+/*
+ * Cancelled probes normally finish promptly. Wait for them to tidy up, but
+ * not past their deadlines
+ */
+static void host_probe_reap(struct host *ctx)
+{
+	struct host_probe *probe, *next;
+
+	list_for_each_safe(&ctx->probes, probe, next, entry) {
+		if (host_probe_join(probe)) {
+			logi("Leaving the %s probe to finish in the background\n",
+			     probe->driver->name);
+			pthread_detach(probe->thread);
+		}
+
+		list_del(&probe->entry);
+		host_probe_put(probe);
+	}
+}
+
+static bool host_probe_fast(struct host *ctx)
+{
+	bool fast;
+
+	pthread_mutex_lock(&ctx->lock);
+	fast = ctx->fast;
+	pthread_mutex_unlock(&ctx->lock);
+
+	return fast;
+}
+
 int host_init(struct host *ctx, struct connection_args *connection)
 {
 	struct bridge_driver **bridges;
+	pthread_condattr_t attr;
 	size_t n_bridges;
-	int rc;
+	bool cancel;
+	int rc = 0;
 
 	/* Always init head for legacy reasons */
 	list_head_init(&ctx->bridges);
+	list_head_init(&ctx->probes);
+	ctx->record = NULL;
+	ctx->split = NULL;
+	ctx->fast = false;
+
+	if ((rc = -pthread_mutex_init(&ctx->lock, NULL)))
+		return rc;
+
+	if ((rc = -pthread_condattr_init(&attr)))
+		goto cleanup_lock;
+
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	rc = -pthread_cond_init(&ctx->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	if (rc)
+		goto cleanup_lock;
 
 	/* If a bridge driver is defined, use it instead of probing all */
 	if (connection->bridge_driver != NULL) {
@@ -130,45 +480,203 @@ int host_init(struct host *ctx, struct connection_args *connection)
 		goto done;
 	}
 
+	/* A requested register bridge must be probed even if slow */
+	cancel = !host_register_bridge;
+
 	bridges = autodata_get(bridge_drivers, &n_bridges);
 	logd("Found %zu registered bridge drivers\n", n_bridges);
 
+	/* Kick off the independent probes in the background */
+	for (size_t i = 0; i < n_bridges; i++) {
+		if (bridges[i]->disabled || bridges[i]->explicit_only) {
+			logd("Skipping bridge driver %s\n", bridges[i]->name);
+			continue;
+		}
+
+		if (bridges[i]->port_io)
+			continue;
+
+		if (host_probe_start(ctx, bridges[i], connection) < 0) {
+			rc = host_probe_bridge(ctx, bridges[i], connection);
+			if (rc < 0)
+				goto cleanup_probes;
+		}
+	}
+
+	/* Meanwhile, take turns with the SuperIO on this thread */
 	for (size_t i = 0; i < n_bridges; i++) {
+		if (!bridges[i]->port_io)
+			continue;
+
+		if (cancel && host_probe_fast(ctx)) {
+			logd("Skipping bridge driver %s, found a fast bridge\n",
+			     bridges[i]->name);
+			continue;
+		}
+
 		rc = host_probe_bridge(ctx, bridges[i], connection);
 		if (rc < 0)
-			goto cleanup_bridges;
+			goto cleanup_probes;
+	}
+
+	host_probe_wait(ctx, cancel);
+
+	rc = host_probe_collect(ctx);
+
+cleanup_probes:
+	if (rc < 0) {
+		host_probe_wait(ctx, true);
+		host_probe_collect(ctx);
+		host_probe_reap(ctx);
 	}
 
-cleanup_bridges:
 	autodata_free(bridges);
 
 done:
+	if (rc < 0) {
+		struct bridge *bridge, *next;
+
+		list_for_each_safe(&ctx->bridges, bridge, next, entry) {
+			bridge->driver->destroy(bridge->ahb);
+			list_del(&bridge->entry);
+			free(bridge);
+		}
+
+		pthread_cond_destroy(&ctx->cond);
+		goto cleanup_lock;
+	}
+
+	return 0;
+
+cleanup_lock:
+	pthread_mutex_destroy(&ctx->lock);
+
 	return rc;
 }
 
 void host_destroy(struct host *ctx)
 {
 	struct bridge *bridge, *next;
+	int rc;
+
+	if (ctx->record) {
+		if ((rc = recb_destroy(ctx->record)) < 0)
+			loge("Failed to complete recording: %d\n", rc);
+		free(ctx->record);
+		ctx->record = NULL;
+	}
+
+	free(ctx->split);
+	ctx->split = NULL;
+
+	/* Give the probes we abandoned until their deadlines to clean up */
+	host_probe_reap(ctx);
 
 	list_for_each_safe(&ctx->bridges, bridge, next, entry) {
+		if (ahb_stats_enabled)
+			ahb_stats_report(bridge->ahb);
 		bridge->driver->destroy(bridge->ahb);
 		list_del(&bridge->entry);
 		free(bridge);
 	}
+
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->lock);
 }
 
-struct ahb *host_get_ahb(struct host *ctx)
+/* Drivers that don't describe their cost sort after those that do */
+static uint64_t host_bridge_cost(const struct bridge *bridge)
 {
-	struct bridge *bridge;
+	return bridge->driver->caps.cost ?: UINT64_MAX;
+}
+
+static struct bridge *host_find_fastest(struct host *ctx)
+{
+	struct bridge *bridge, *fastest = NULL;
+
+	list_for_each(&ctx->bridges, bridge, entry) {
+		logd("Bridge %s costs %" PRIu64 "ns/KiB\n", bridge->driver->name,
+		     bridge->driver->caps.cost);
+
+		if (!fastest ||
+		    host_bridge_cost(bridge) < host_bridge_cost(fastest))
+			fastest = bridge;
+	}
+
+	return fastest;
+}
 
-	bridge = list_top(&ctx->bridges, struct bridge, entry);
+static struct bridge *host_find_bridge(struct host *ctx, const char *name)
+{
+	struct bridge *bridge;
 
-	if (bridge) {
-		logd("Accessing the BMC's AHB via the %s bridge\n",
-		     bridge->driver->name);
-		return bridge->ahb;
+	list_for_each(&ctx->bridges, bridge, entry) {
+		if (!strcmp(bridge->driver->name, name))
+			return bridge;
 	}
 
-	loge("Bridge discovery failed, cannot access BMC AHB\n");
 	return NULL;
 }
+
+static struct ahb *host_select_ahb(struct host *ctx)
+{
+	struct bridge *bulk, *reg;
+
+	if (ctx->split)
+		return splitb_as_ahb(ctx->split);
+
+	if (!(bulk = host_find_fastest(ctx)))
+		return NULL;
+
+	logd("Accessing the BMC's AHB via the %s bridge\n", bulk->driver->name);
+
+	if (!host_register_bridge)
+		return bulk->ahb;
+
+	reg = host_find_bridge(ctx, host_register_bridge);
+	if (!reg) {
+		logi("Register bridge %s not found, using %s for all accesses\n",
+		     host_register_bridge, bulk->driver->name);
+		return bulk->ahb;
+	}
+
+	if (reg == bulk)
+		return bulk->ahb;
+
+	if (!(ctx->split = malloc(sizeof(*ctx->split))))
+		return NULL;
+
+	splitb_init(ctx->split, bulk->ahb, reg->ahb);
+
+	return splitb_as_ahb(ctx->split);
+}
+
+struct ahb *host_get_ahb(struct host *ctx)
+{
+	struct ahb *ahb;
+
+	if (list_empty(&ctx->bridges)) {
+		loge("Bridge discovery failed, cannot access BMC AHB\n");
+		return NULL;
+	}
+
+	if (!(ahb = host_select_ahb(ctx)))
+		return NULL;
+
+	if (!host_record_path)
+		return ahb;
+
+	if (ctx->record)
+		return recb_as_ahb(ctx->record);
+
+	if (!(ctx->record = malloc(sizeof(*ctx->record))))
+		return NULL;
+
+	if (recb_init(ctx->record, ahb, host_record_path) < 0) {
+		free(ctx->record);
+		ctx->record = NULL;
+		return NULL;
+	}
+
+	return recb_as_ahb(ctx->record);
+}
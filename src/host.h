@@ -9,10 +9,33 @@
 
 #include "ccan/list/list.h"
 
+#include <pthread.h>
+#include <stdbool.h>
+
+struct recb;
+struct splitb;
+
 struct host {
 	struct list_head bridges;
+	struct recb *record;
+	struct splitb *split;
+
+	/* Background bridge probes */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct list_head probes;
+	bool fast;
 };
 
+/* Record all accesses through the bridge returned by host_get_ahb() to @path */
+void host_set_record_path(const char *path);
+
+/*
+ * Issue register accesses through the @name bridge, leaving bulk transfers to
+ * the fastest bridge found
+ */
+void host_set_register_bridge(const char *name);
+
 int host_init(struct host *ctx, struct connection_args *connection);
 void host_destroy(struct host *ctx);
 
@@ -38,16 +61,23 @@ void print_bridge_drivers(void);
  */
 int get_bridge_driver(const char *drv, struct bridge_driver **bridge);
 
+/**
+ * host_get_ahb - Return an AHB interface backed by the probed bridges
+ *
+ * Where several bridges were found, the one with the lowest transfer cost is
+ * used. If a register bridge has been set with host_set_register_bridge() and
+ * was found, bulk transfers and register accesses are split between the two.
+ */
 struct ahb *host_get_ahb(struct host *ctx);
 
 static inline int host_bridge_release_from_ahb(struct ahb *ahb)
 {
-	return ahb->drv->release ? ahb->drv->release(ahb) : 0;
+	return ahb_release_bridge(ahb);
 }
 
 static inline int host_bridge_reinit_from_ahb(struct ahb *ahb)
 {
-	return ahb->drv->reinit ? ahb->drv->reinit(ahb) : 0;
+	return ahb_reinit_bridge(ahb);
 }
 
 #endif
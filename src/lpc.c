@@ -0,0 +1,512 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "lpc.h"
+#include "log.h"
+#include "simsio.h"
+
+#include "ccan/autodata/autodata.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const struct lpc_backend *lpc_selected;
+static const char *lpc_selected_args;
+
+static const struct lpc_backend *lpc_find_backend(const char *name,
+						  size_t len)
+{
+	const struct lpc_backend *found = NULL;
+	struct lpc_backend **backends;
+	size_t n_backends;
+
+	backends = autodata_get(lpc_backends, &n_backends);
+
+	for (size_t i = 0; i < n_backends; i++) {
+		if (name ? (strlen(backends[i]->name) == len &&
+			    !strncmp(backends[i]->name, name, len)) :
+			   backends[i]->preferred) {
+			found = backends[i];
+			break;
+		}
+	}
+
+	autodata_free(backends);
+
+	return found;
+}
+
+int lpc_set_backend(const char *spec)
+{
+	const struct lpc_backend *backend;
+	const char *args;
+	size_t len;
+
+	args = strchr(spec, ':');
+	len = args ? (size_t)(args - spec) : strlen(spec);
+
+	if (!(backend = lpc_find_backend(spec, len)))
+		return -ENOENT;
+
+	lpc_selected = backend;
+	lpc_selected_args = args ? args + 1 : NULL;
+
+	return 0;
+}
+
+void print_lpc_backends(void)
+{
+	struct lpc_backend **backends;
+	size_t n_backends;
+
+	printf("Available LPC backends:\n");
+
+	backends = autodata_get(lpc_backends, &n_backends);
+
+	for (size_t i = 0; i < n_backends; i++)
+		printf("  %s%s\n", backends[i]->name,
+		       backends[i]->preferred ? " (default)" : "");
+
+	autodata_free(backends);
+}
+
+int lpc_init(struct lpc *ctx, const char *space)
+{
+	const struct lpc_backend *backend;
+	int rc;
+
+	backend = lpc_selected ?: lpc_find_backend(NULL, 0);
+	if (!backend)
+		return -ENOTSUP;
+
+	ctx->fd = -1;
+	ctx->space = space;
+	ctx->backend = backend;
+	ctx->priv = NULL;
+	ctx->size = 0;
+	ctx->base = 0;
+	ctx->queued = 0;
+
+	rc = backend->init(ctx, space, lpc_selected ? lpc_selected_args : NULL);
+	if (rc < 0)
+		logd("lpc: Failed to initialise %s backend for %s space: %d\n",
+		     backend->name, space, rc);
+
+	return rc;
+}
+
+int lpc_destroy(struct lpc *ctx)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		loge("lpc: Failed to issue queued accesses: %d\n", rc);
+
+	return ctx->backend->destroy ? ctx->backend->destroy(ctx) : 0;
+}
+
+/* Issue an access immediately, bypassing the queue */
+static int __lpc_readb(struct lpc *ctx, size_t addr, uint8_t *val)
+{
+	int rc;
+
+	if (ctx->backend->readb)
+		return ctx->backend->readb(ctx, addr, val);
+
+	if (!ctx->backend->read)
+		return -ENOTSUP;
+
+	rc = ctx->backend->read(ctx, addr, val, sizeof(*val));
+
+	return rc < 0 ? rc : 0;
+}
+
+static int __lpc_writeb(struct lpc *ctx, size_t addr, uint8_t val)
+{
+	int rc;
+
+	if (ctx->backend->writeb)
+		return ctx->backend->writeb(ctx, addr, val);
+
+	if (!ctx->backend->write)
+		return -ENOTSUP;
+
+	rc = ctx->backend->write(ctx, addr, &val, sizeof(val));
+
+	return rc < 0 ? rc : 0;
+}
+
+int lpc_flush(struct lpc *ctx)
+{
+	size_t n = ctx->queued;
+
+	if (!n)
+		return 0;
+
+	ctx->queued = 0;
+
+	return ctx->backend->batch(ctx, ctx->queue, n);
+}
+
+static int lpc_queue(struct lpc *ctx, size_t addr, uint8_t *dst, uint8_t val)
+{
+	struct lpc_op *op;
+	int rc;
+
+	if (ctx->queued == LPC_QUEUE_LEN && (rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	op = &ctx->queue[ctx->queued++];
+	op->addr = addr;
+	op->dst = dst;
+	op->val = val;
+
+	return 0;
+}
+
+int lpc_queue_readb(struct lpc *ctx, size_t addr, uint8_t *val)
+{
+	if (!ctx->backend->batch)
+		return __lpc_readb(ctx, addr, val);
+
+	return lpc_queue(ctx, addr, val, 0);
+}
+
+int lpc_queue_writeb(struct lpc *ctx, size_t addr, uint8_t val)
+{
+	if (!ctx->backend->batch)
+		return __lpc_writeb(ctx, addr, val);
+
+	return lpc_queue(ctx, addr, NULL, val);
+}
+
+int lpc_read(struct lpc *ctx, size_t addr, void *val, size_t size)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	if (!ctx->backend->read)
+		return -ENOTSUP;
+
+	return ctx->backend->read(ctx, addr, val, size);
+}
+
+int lpc_write(struct lpc *ctx, size_t addr, const void *val, size_t size)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	if (!ctx->backend->write)
+		return -ENOTSUP;
+
+	return ctx->backend->write(ctx, addr, val, size);
+}
+
+/* Values are in host byte order, as with the port I/O instructions */
+int lpc_readb(struct lpc *ctx, size_t addr, uint8_t *val)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	return __lpc_readb(ctx, addr, val);
+}
+
+int lpc_writeb(struct lpc *ctx, size_t addr, uint8_t val)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	return __lpc_writeb(ctx, addr, val);
+}
+
+int lpc_readw(struct lpc *ctx, size_t addr, uint16_t *val)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	if (ctx->backend->readw)
+		return ctx->backend->readw(ctx, addr, val);
+
+	rc = lpc_read(ctx, addr, val, sizeof(*val));
+
+	return rc < 0 ? rc : 0;
+}
+
+int lpc_writew(struct lpc *ctx, size_t addr, uint16_t val)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	if (ctx->backend->writew)
+		return ctx->backend->writew(ctx, addr, val);
+
+	rc = lpc_write(ctx, addr, &val, sizeof(val));
+
+	return rc < 0 ? rc : 0;
+}
+
+int lpc_readl(struct lpc *ctx, size_t addr, uint32_t *val)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	if (ctx->backend->readl)
+		return ctx->backend->readl(ctx, addr, val);
+
+	rc = lpc_read(ctx, addr, val, sizeof(*val));
+
+	return rc < 0 ? rc : 0;
+}
+
+int lpc_writel(struct lpc *ctx, size_t addr, uint32_t val)
+{
+	int rc;
+
+	if ((rc = lpc_flush(ctx)) < 0)
+		return rc;
+
+	if (ctx->backend->writel)
+		return ctx->backend->writel(ctx, addr, val);
+
+	rc = lpc_write(ctx, addr, &val, sizeof(val));
+
+	return rc < 0 ? rc : 0;
+}
+
+/* /dev/port: Slow, but needs neither iopl() nor ioperm() */
+static int lpc_devport_init(struct lpc *ctx, const char *space,
+			    const char *args __unused)
+{
+	if (strcmp(space, "io"))
+		return -ENOTSUP;
+
+	ctx->fd = open("/dev/port", O_RDWR | O_CLOEXEC);
+	if (ctx->fd < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int lpc_devport_destroy(struct lpc *ctx)
+{
+	return close(ctx->fd) ? -errno : 0;
+}
+
+static int lpc_devport_read(struct lpc *ctx, size_t addr, void *val,
+			    size_t size)
+{
+	ssize_t rc;
+
+	rc = pread(ctx->fd, val, size, addr);
+	if (rc < 0)
+		return -errno;
+
+	return rc;
+}
+
+static int lpc_devport_write(struct lpc *ctx, size_t addr, const void *val,
+			     size_t size)
+{
+	ssize_t rc;
+
+	rc = pwrite(ctx->fd, val, size, addr);
+	if (rc < 0)
+		return -errno;
+
+	return rc;
+}
+
+static const struct lpc_backend lpc_devport_backend = {
+	.name = "devport",
+	.init = lpc_devport_init,
+	.destroy = lpc_devport_destroy,
+	.read = lpc_devport_read,
+	.write = lpc_devport_write,
+};
+REGISTER_LPC_BACKEND(lpc_devport_backend);
+
+/*
+ * The simulated SuperIO is a single device however many contexts use it, so
+ * its state is shared between them.
+ */
+static struct sim_sio *lpc_sim;
+static unsigned int lpc_sim_users;
+
+/* The window that is the FW space as with x86's fw=PHYS, or 0 for all of it */
+static uint32_t lpc_sim_fw_base;
+static size_t lpc_sim_fw_len;
+
+/* LPC[+LEN] */
+static int lpc_sim_parse_fw(const char *arg)
+{
+	unsigned long long base, len = 64 << 10;
+	char *end;
+
+	errno = 0;
+	base = strtoull(arg, &end, 0);
+	if (!errno && *end == '+')
+		len = strtoull(end + 1, &end, 0);
+
+	if (errno || *end || end == arg || !len || base + len < base ||
+	    base + len > (1ULL << 32)) {
+		loge("lpc: Invalid firmware window '%s'\n", arg);
+		return -EINVAL;
+	}
+
+	lpc_sim_fw_base = base;
+	lpc_sim_fw_len = len;
+
+	return 0;
+}
+
+/* IMAGE[,soc=SOC][,fw=LPC[+LEN]] */
+static int lpc_sim_init(struct lpc *ctx, const char *space, const char *args)
+{
+	const char *soc = "ast2500";
+	char *opts, *image, *opt, *save;
+	int rc;
+
+	if (strcmp(space, "io") && strcmp(space, "fw"))
+		return -ENOTSUP;
+
+	if (lpc_sim)
+		goto done;
+
+	if (!args) {
+		loge("lpc: The sim backend requires an image path\n");
+		return -EINVAL;
+	}
+
+	if (!(opts = strdup(args)))
+		return -ENOMEM;
+
+	image = strtok_r(opts, ",", &save);
+	while ((opt = strtok_r(NULL, ",", &save))) {
+		if (!strncmp(opt, "soc=", strlen("soc="))) {
+			soc = opt + strlen("soc=");
+		} else if (!strncmp(opt, "fw=", strlen("fw="))) {
+			if ((rc = lpc_sim_parse_fw(opt + strlen("fw="))) < 0)
+				goto cleanup_opts;
+		} else {
+			loge("lpc: Unrecognised sim option '%s'\n", opt);
+			rc = -EINVAL;
+			goto cleanup_opts;
+		}
+	}
+
+	if (!(lpc_sim = malloc(sizeof(*lpc_sim)))) {
+		rc = -ENOMEM;
+		goto cleanup_opts;
+	}
+
+	if ((rc = sim_sio_init(lpc_sim, image, soc)) < 0) {
+		free(lpc_sim);
+		lpc_sim = NULL;
+		goto cleanup_opts;
+	}
+
+	free(opts);
+
+done:
+	lpc_sim_users++;
+	ctx->priv = lpc_sim;
+
+	if (!strcmp(space, "fw")) {
+		ctx->base = lpc_sim_fw_base;
+		ctx->size = lpc_sim_fw_len;
+	}
+
+	return 0;
+
+cleanup_opts:
+	free(opts);
+
+	return rc;
+}
+
+static int lpc_sim_destroy(struct lpc *ctx __unused)
+{
+	if (--lpc_sim_users)
+		return 0;
+
+	lpc_sim_fw_base = 0;
+	lpc_sim_fw_len = 0;
+
+	sim_sio_destroy(lpc_sim);
+	free(lpc_sim);
+	lpc_sim = NULL;
+
+	return 0;
+}
+
+static int lpc_sim_read(struct lpc *ctx, size_t addr, void *val, size_t size)
+{
+	struct sim_sio *sim = ctx->priv;
+	uint8_t *buf = val;
+	size_t i;
+	int rc;
+
+	if (!strcmp(ctx->space, "fw")) {
+		if (ctx->size && (addr > ctx->size || size > ctx->size - addr))
+			return -EINVAL;
+
+		return sim_sio_fw_read(sim, ctx->base + addr, val, size);
+	}
+
+	/* Multi-byte port accesses are consecutive byte accesses, LSB first */
+	for (i = 0; i < size; i++) {
+		if ((rc = sim_sio_inb(sim, addr + i, &buf[i])) < 0)
+			return rc;
+	}
+
+	return size;
+}
+
+static int lpc_sim_write(struct lpc *ctx, size_t addr, const void *val,
+			 size_t size)
+{
+	struct sim_sio *sim = ctx->priv;
+	const uint8_t *buf = val;
+	size_t i;
+	int rc;
+
+	if (!strcmp(ctx->space, "fw")) {
+		if (ctx->size && (addr > ctx->size || size > ctx->size - addr))
+			return -EINVAL;
+
+		return sim_sio_fw_write(sim, ctx->base + addr, val, size);
+	}
+
+	for (i = 0; i < size; i++) {
+		if ((rc = sim_sio_outb(sim, addr + i, buf[i])) < 0)
+			return rc;
+	}
+
+	return size;
+}
+
+static const struct lpc_backend lpc_sim_backend = {
+	.name = "sim",
+	.init = lpc_sim_init,
+	.destroy = lpc_sim_destroy,
+	.read = lpc_sim_read,
+	.write = lpc_sim_write,
+};
+REGISTER_LPC_BACKEND(lpc_sim_backend);
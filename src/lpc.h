@@ -7,16 +7,84 @@
 #include "config.h"
 #include "compiler.h"
 
+#include "ccan/autodata/autodata.h"
+
 #include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+struct lpc_backend;
+
+/* A byte-wide port access queued with lpc_queue_readb()/lpc_queue_writeb() */
+struct lpc_op {
+	size_t addr;
+	/* Where a read stores its result, or NULL for a write */
+	uint8_t *dst;
+	uint8_t val;
+};
+
+#define LPC_QUEUE_LEN 64
+
 struct lpc {
 	int fd;
 	const char *space;
+	const struct lpc_backend *backend;
+	void *priv;
+	/* The extent of the space if the backend only reaches part of it */
+	size_t size;
+	/* The LPC address that offset 0 of the space is issued with */
+	uint32_t base;
+
+	struct lpc_op queue[LPC_QUEUE_LEN];
+	size_t queued;
+};
+
+/*
+ * A means of issuing LPC cycles from the host. @space is one of "io", "fw" or
+ * "mem", and @args are the options given after the backend's name to
+ * lpc_set_backend(), or NULL.
+ *
+ * The sized accessors are optional if read() and write() are provided. init()
+ * may hand a space it doesn't reach itself to another backend by replacing
+ * ctx->backend, and sets ctx->size and ctx->base if only part of the space is
+ * reachable.
+ */
+struct lpc_backend {
+	const char *name;
+
+	/* Used when no backend is selected with lpc_set_backend() */
+	bool preferred;
+
+	int (*init)(struct lpc *ctx, const char *space, const char *args);
+	int (*destroy)(struct lpc *ctx);
+
+	int (*readb)(struct lpc *ctx, size_t addr, uint8_t *val);
+	int (*writeb)(struct lpc *ctx, size_t addr, uint8_t val);
+	int (*readw)(struct lpc *ctx, size_t addr, uint16_t *val);
+	int (*writew)(struct lpc *ctx, size_t addr, uint16_t val);
+	int (*readl)(struct lpc *ctx, size_t addr, uint32_t *val);
+	int (*writel)(struct lpc *ctx, size_t addr, uint32_t val);
+
+	int (*read)(struct lpc *ctx, size_t addr, void *val, size_t size);
+	int (*write)(struct lpc *ctx, size_t addr, const void *val,
+		     size_t size);
+
+	/*
+	 * Optional: Issue a sequence of accesses in order, more cheaply than
+	 * one at a time. Without it, queued accesses are issued immediately.
+	 */
+	int (*batch)(struct lpc *ctx, struct lpc_op *ops, size_t n);
 };
 
+AUTODATA_TYPE(lpc_backends, struct lpc_backend);
+#define REGISTER_LPC_BACKEND(lb) AUTODATA_SYM(lpc_backends, lb)
+
 #if HAVE_LPC
+/* Select the backend used by subsequent lpc_init() calls: NAME[:ARGS] */
+int lpc_set_backend(const char *spec);
+void print_lpc_backends(void);
+
 int lpc_init(struct lpc *ctx, const char *space);
 int lpc_destroy(struct lpc *ctx);
 
@@ -29,7 +97,26 @@ int lpc_writel(struct lpc *ctx, size_t addr, uint32_t val);
 
 int lpc_read(struct lpc *ctx, size_t addr, void *val, size_t size);
 int lpc_write(struct lpc *ctx, size_t addr, const void *val, size_t size);
+
+/*
+ * Queue accesses for the backend to issue together. A queued read stores its
+ * result through @val once issued, so @val must remain valid until
+ * lpc_flush(). The queue is flushed when full, and before any unqueued
+ * access so ordering is preserved.
+ */
+int lpc_queue_readb(struct lpc *ctx, size_t addr, uint8_t *val);
+int lpc_queue_writeb(struct lpc *ctx, size_t addr, uint8_t val);
+int lpc_flush(struct lpc *ctx);
 #else
+static inline int lpc_set_backend(const char *spec __unused)
+{
+	return -ENOTSUP;
+}
+
+static inline void print_lpc_backends(void)
+{
+}
+
 static inline int lpc_init(struct lpc *ctx __unused, const char *space __unused)
 {
 	return -ENOTSUP;
@@ -87,6 +174,23 @@ static inline int lpc_write(struct lpc *ctx __unused, size_t addr __unused,
 {
 	return -ENOTSUP;
 }
+
+static inline int lpc_queue_readb(struct lpc *ctx __unused,
+				  size_t addr __unused, uint8_t *val __unused)
+{
+	return -ENOTSUP;
+}
+
+static inline int lpc_queue_writeb(struct lpc *ctx __unused,
+				   size_t addr __unused, uint8_t val __unused)
+{
+	return -ENOTSUP;
+}
+
+static inline int lpc_flush(struct lpc *ctx __unused)
+{
+	return -ENOTSUP;
+}
 #endif
 
 #endif
@@ -4,46 +4,209 @@
 #include "mb.h"
 #include "mmio.h"
 
+#include <errno.h>
 #include <stdint.h>
+#include <string.h>
 
-volatile void *mmio_memcpy(volatile void *restrict dst,
-			   const volatile void *restrict src, size_t len)
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static unsigned int mmio_width_override;
+
+int mmio_set_width(unsigned int width)
 {
-	if (((unsigned long)src & 0x3) != ((unsigned long)dst & 0x3)) {
-		while (len) {
-			*(volatile uint8_t *restrict)dst++ =
-				*(const volatile uint8_t *restrict)src++;
-			len--;
-		}
+	if (width && (width & (width - 1)))
+		return -EINVAL;
 
-		iob();
+	if (width > 32)
+		return -EINVAL;
 
-		return dst;
-	}
+	mmio_width_override = width;
 
-	while (len && ((unsigned long)src & 0x3) &&
-	       ((unsigned long)dst & 0x3)) {
-		*(volatile uint8_t *restrict)dst++ =
-			*(const volatile uint8_t *restrict)src++;
-		len--;
+	return 0;
+}
+
+#if defined(__x86_64__)
+/*
+ * SSE2 is part of the baseline. The non-temporal loads also stream from
+ * write-combining mappings, and otherwise behave as plain loads.
+ */
+static unsigned int mmio_cpu_width(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2") ? 32 : 16;
+}
+
+__attribute__((target("sse4.1"))) static void
+mmio_read16_sse41(void *dst, const volatile void *src)
+{
+	_mm_storeu_si128(dst, _mm_stream_load_si128((__m128i *)src));
+}
+
+static void mmio_read16(void *dst, const volatile void *src)
+{
+	static int sse41 = -1;
+
+	if (sse41 < 0) {
+		__builtin_cpu_init();
+		sse41 = __builtin_cpu_supports("sse4.1");
 	}
 
-	while (len > 3) {
-		const volatile uint32_t *restrict tsrc = src;
-		volatile uint32_t *restrict tdst = dst;
-		*tdst = *tsrc;
-		len -= sizeof(*tdst);
-		src += sizeof(*tsrc);
-		dst += sizeof(*tdst);
+	if (sse41) {
+		mmio_read16_sse41(dst, src);
+		return;
 	}
 
+	_mm_storeu_si128(dst, _mm_load_si128((const __m128i *)src));
+}
+
+__attribute__((target("avx2"))) static void
+mmio_read32(void *dst, const volatile void *src)
+{
+	_mm256_storeu_si256(dst, _mm256_stream_load_si256((__m256i *)src));
+}
+
+static void mmio_write16(volatile void *dst, const void *src)
+{
+	_mm_stream_si128((__m128i *)dst, _mm_loadu_si128(src));
+}
+
+__attribute__((target("avx2"))) static void
+mmio_write32(volatile void *dst, const void *src)
+{
+	_mm256_stream_si256((__m256i *)dst, _mm256_loadu_si256(src));
+}
+#else
+static unsigned int mmio_cpu_width(void)
+{
+	return sizeof(unsigned long);
+}
+#endif
+
+unsigned int mmio_width(unsigned int safe)
+{
+	static unsigned int cpu;
+	unsigned int width;
+
+	if (!cpu)
+		cpu = mmio_cpu_width();
+
+	width = mmio_width_override ?: safe ?: MMIO_WIDTH_DEFAULT;
+
+	return width < cpu ? width : cpu;
+}
+
+/* The largest naturally aligned access at @addr of at most @width and @len */
+static inline size_t mmio_step(uintptr_t addr, size_t len, unsigned int width)
+{
+	size_t step = width;
+
+	while (step > 1 && ((addr & (step - 1)) || step > len))
+		step >>= 1;
+
+	return step;
+}
+
+void mmio_read(void *dst, const volatile void *src, size_t len,
+	       unsigned int width)
+{
+	uint8_t *d = dst;
+	const volatile uint8_t *s = src;
+
 	while (len) {
-		*(volatile uint8_t *restrict)dst++ =
-			*(const volatile uint8_t *restrict)src++;
-		len--;
+		size_t step = mmio_step((uintptr_t)s, len, width);
+
+		switch (step) {
+		case 1:
+			*d = *s;
+			break;
+		case 2: {
+			uint16_t v = *(const volatile uint16_t *)s;
+
+			memcpy(d, &v, sizeof(v));
+			break;
+		}
+		case 4: {
+			uint32_t v = *(const volatile uint32_t *)s;
+
+			memcpy(d, &v, sizeof(v));
+			break;
+		}
+		case 8: {
+			uint64_t v = *(const volatile uint64_t *)s;
+
+			memcpy(d, &v, sizeof(v));
+			break;
+		}
+#if defined(__x86_64__)
+		case 16:
+			mmio_read16(d, s);
+			break;
+		case 32:
+			mmio_read32(d, s);
+			break;
+#endif
+		}
+
+		d += step;
+		s += step;
+		len -= step;
 	}
 
 	iob();
+}
+
+void mmio_write(volatile void *dst, const void *src, size_t len,
+		unsigned int width)
+{
+	volatile uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	while (len) {
+		size_t step = mmio_step((uintptr_t)d, len, width);
+
+		switch (step) {
+		case 1:
+			*d = *s;
+			break;
+		case 2: {
+			uint16_t v;
+
+			memcpy(&v, s, sizeof(v));
+			*(volatile uint16_t *)d = v;
+			break;
+		}
+		case 4: {
+			uint32_t v;
 
-	return dst;
+			memcpy(&v, s, sizeof(v));
+			*(volatile uint32_t *)d = v;
+			break;
+		}
+		case 8: {
+			uint64_t v;
+
+			memcpy(&v, s, sizeof(v));
+			*(volatile uint64_t *)d = v;
+			break;
+		}
+#if defined(__x86_64__)
+		case 16:
+			mmio_write16(d, s);
+			break;
+		case 32:
+			mmio_write32(d, s);
+			break;
+#endif
+		}
+
+		d += step;
+		s += step;
+		len -= step;
+	}
+
+	/* Also orders the streaming stores */
+	iob();
 }
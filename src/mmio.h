@@ -6,7 +6,25 @@
 
 #include <stddef.h>
 
-volatile void *mmio_memcpy(volatile void *dst, const volatile void *src,
-			   size_t len);
+/* The widest access that's safe through any bridge's MMIO window */
+#define MMIO_WIDTH_DEFAULT 4
+
+/* Override the bridges' choice of access width, or 0 to defer to them */
+int mmio_set_width(unsigned int width);
+
+/*
+ * The widest access to issue through a window that tolerates accesses of up
+ * to @safe bytes, given any override and what the CPU can do.
+ */
+unsigned int mmio_width(unsigned int safe);
+
+/*
+ * Copy between MMIO and memory using naturally aligned accesses of up to
+ * @width bytes on the MMIO side, whatever the alignment of the memory side.
+ */
+void mmio_read(void *dst, const volatile void *src, size_t len,
+	       unsigned int width);
+void mmio_write(volatile void *dst, const void *src, size_t len,
+		unsigned int width);
 
 #endif
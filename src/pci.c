@@ -42,7 +42,8 @@ int read_sysfs_id(int dirfd, const char *file)
 	return id;
 }
 
-int pci_open(uint16_t vid, uint16_t did, int bar)
+static int pci_open_resource(uint16_t vid, uint16_t did, int bar,
+			     const char *suffix, int flags)
 {
 	char *res;
 	int rc;
@@ -84,19 +85,32 @@ int pci_open(uint16_t vid, uint16_t did, int bar)
 		return -ENOENT;
 	}
 
-	rc = asprintf(&res, "%s/resource%d", de->d_name, bar);
+	rc = asprintf(&res, "%s/resource%d%s", de->d_name, bar, suffix);
 	if (rc == -1) {
 		closedir(d);
 		return -errno;
 	}
 
-	fd = openat(dfd, res, O_RDWR | O_SYNC);
+	fd = openat(dfd, res, flags);
+	if (fd < 0)
+		fd = -errno;
 	free(res);
 	closedir(d);
 
 	return fd;
 }
 
+int pci_open(uint16_t vid, uint16_t did, int bar)
+{
+	return pci_open_resource(vid, did, bar, "", O_RDWR | O_SYNC);
+}
+
+/* Only prefetchable BARs can be mapped write-combining */
+int pci_open_wc(uint16_t vid, uint16_t did, int bar)
+{
+	return pci_open_resource(vid, did, bar, "_wc", O_RDWR);
+}
+
 int pci_close(int fd)
 {
 	assert(fd >= 0);
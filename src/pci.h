@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 int pci_open(uint16_t vid, uint16_t did, int bar);
+int pci_open_wc(uint16_t vid, uint16_t did, int bar);
 
 int pci_close(int fd);
 
@@ -2,9 +2,11 @@
 // Copyright (C) 2018,2019 IBM Corp.
 
 #define _GNU_SOURCE
+#include "array.h"
 #include "prompt.h"
 
 #include <errno.h>
+#include <poll.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,14 +14,17 @@
 
 int prompt_init(struct prompt *ctx, int fd, const char *eol, bool have_echo)
 {
-	ctx->stream = fdopen(fd, "r+");
-	if (!ctx->stream)
-		return -errno;
+	ctx->fd = fd;
 
 	ctx->eol = eol;
 
 	ctx->have_echo = have_echo;
 
+	ctx->cancel_fd = -1;
+
+	ctx->head = 0;
+	ctx->tail = 0;
+
 	return 0;
 }
 
@@ -27,25 +32,130 @@ int prompt_destroy(struct prompt *ctx)
 {
 	int rc;
 
-	rc = fclose(ctx->stream);
+	rc = close(ctx->fd);
 	if (rc < 0)
 		return -errno;
 
 	return 0;
 }
 
+void prompt_set_cancel(struct prompt *ctx, int fd)
+{
+	ctx->cancel_fd = fd;
+}
+
+/*
+ * Wait for the device to become readable, or with @wait false just check for
+ * cancellation. Returns -ECANCELED once the cancel fd is readable.
+ */
+static int prompt_wait(struct prompt *ctx, bool wait)
+{
+	struct pollfd fds[] = {
+		{ .fd = ctx->cancel_fd, .events = POLLIN },
+		{ .fd = ctx->fd, .events = POLLIN },
+	};
+	int rc;
+
+	if (ctx->cancel_fd < 0)
+		return 0;
+
+	do {
+		rc = poll(fds, wait ? ARRAY_SIZE(fds) : 1, wait ? -1 : 0);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc < 0)
+		return -errno;
+
+	return fds[0].revents ? -ECANCELED : 0;
+}
+
+/*
+ * All reads go through the ring, so whatever arrives beyond the data a caller
+ * asked for is kept for the next caller rather than lost in a stdio buffer.
+ */
+static ssize_t prompt_fill(struct prompt *ctx)
+{
+	size_t used = ctx->head - ctx->tail;
+	size_t offset = ctx->head % PROMPT_RING_LEN;
+	size_t space = PROMPT_RING_LEN - offset;
+	ssize_t ingress;
+
+	if (space > PROMPT_RING_LEN - used)
+		space = PROMPT_RING_LEN - used;
+
+	if (!space)
+		return -ENOBUFS;
+
+	if ((ingress = prompt_wait(ctx, true)) < 0)
+		return ingress;
+
+	do {
+		ingress = read(ctx->fd, &ctx->ring[offset], space);
+	} while (ingress < 0 && errno == EINTR);
+
+	if (ingress < 0)
+		return -errno;
+
+	if (!ingress)
+		return -EIO;
+
+	ctx->head += ingress;
+
+	return ingress;
+}
+
+ssize_t prompt_peek(struct prompt *ctx, const char **data)
+{
+	size_t offset, avail;
+	ssize_t rc;
+
+	if (ctx->head == ctx->tail) {
+		if ((rc = prompt_fill(ctx)) < 0)
+			return rc;
+	}
+
+	offset = ctx->tail % PROMPT_RING_LEN;
+	avail = ctx->head - ctx->tail;
+	if (avail > PROMPT_RING_LEN - offset)
+		avail = PROMPT_RING_LEN - offset;
+
+	*data = &ctx->ring[offset];
+
+	return avail;
+}
+
+void prompt_consume(struct prompt *ctx, size_t len)
+{
+	ctx->tail += len;
+}
+
 int prompt_gets(struct prompt *ctx, char *output, size_t len)
 {
+	const char *data, *eol;
 	char *cursor;
-	char *res;
+	ssize_t avail;
+	size_t n;
+
+	if (!len)
+		return -EINVAL;
 
 	cursor = output;
 	do {
-		res = fgets(cursor, len, ctx->stream);
-		if (!res)
-			return -errno;
-		cursor += strlen(res);
-	} while (!strchr(output, '\n'));
+		avail = prompt_peek(ctx, &data);
+		if (avail < 0)
+			return avail;
+
+		eol = memchr(data, '\n', avail);
+		n = eol ? (size_t)(eol - data + 1) : (size_t)avail;
+		if (n > (size_t)(output + len - 1 - cursor))
+			return -EOVERFLOW;
+
+		memcpy(cursor, data, n);
+		prompt_consume(ctx, n);
+		cursor += n;
+	} while (!eol);
+
+	*cursor = '\0';
 
 	return 0;
 }
@@ -53,20 +163,31 @@ int prompt_gets(struct prompt *ctx, char *output, size_t len)
 int prompt_expect_into(struct prompt *ctx, const char *str, char *prior,
 		       size_t len, char **prompt)
 {
+	size_t n, slen = strlen(str);
+	const char *data;
 	ssize_t ingress;
 	char *cursor;
 	char *res;
 
 	cursor = prior;
 	do {
-		ingress =
-			read(fileno(ctx->stream), cursor, prior + len - cursor);
+		ingress = prompt_peek(ctx, &data);
 		if (ingress < 0)
-			return -errno;
+			return ingress;
+
+		n = prior + len - cursor;
+		if (n > (size_t)ingress)
+			n = ingress;
+		memcpy(cursor, data, n);
 
-		cursor += ingress;
-	} while (!(res = memmem(prior, cursor - prior, str, strlen(str))) &&
-		 (ptrdiff_t)len > (cursor - prior));
+		/* Leave anything after the match for the next reader */
+		res = memmem(prior, cursor + n - prior, str, slen);
+		if (res)
+			n = res + slen - cursor;
+
+		prompt_consume(ctx, n);
+		cursor += n;
+	} while (!res && (ptrdiff_t)len > (cursor - prior));
 
 	if (prompt)
 		*prompt = res;
@@ -93,9 +214,12 @@ ssize_t prompt_write(struct prompt *ctx, const char *buf, size_t len)
 	const char *cursor;
 	ssize_t egress;
 
+	if ((egress = prompt_wait(ctx, false)) < 0)
+		return egress;
+
 	cursor = buf;
 	do {
-		egress = write(fileno(ctx->stream), cursor, buf + len - cursor);
+		egress = write(ctx->fd, cursor, buf + len - cursor);
 		if (egress < 0)
 			return -errno;
 
@@ -107,17 +231,24 @@ ssize_t prompt_write(struct prompt *ctx, const char *buf, size_t len)
 
 ssize_t prompt_read(struct prompt *ctx, char *output, size_t len)
 {
+	const char *data;
 	char *cursor;
 	ssize_t ingress;
+	size_t n;
 
 	cursor = output;
 	do {
-		ingress = read(fileno(ctx->stream), cursor,
-			       output + len - cursor);
+		ingress = prompt_peek(ctx, &data);
 		if (ingress < 0)
-			return -errno;
+			return ingress;
+
+		n = output + len - cursor;
+		if (n > (size_t)ingress)
+			n = ingress;
 
-		cursor += ingress;
+		memcpy(cursor, data, n);
+		prompt_consume(ctx, n);
+		cursor += n;
 	} while (cursor < (output + len));
 
 	return len;
@@ -137,17 +268,18 @@ int prompt_run(struct prompt *ctx, const char *cmd)
 		return rc;
 
 	if (ctx->have_echo) {
-		char *echo, *res;
-		size_t eol_len = len + strlen(ctx->eol) + 1;
+		/* The command, its EOL, the terminal's newline and a NUL */
+		size_t eol_len = len + strlen(ctx->eol) + 2;
+		char *echo;
 
 		echo = malloc(eol_len);
 		if (!echo)
 			return -errno;
 
-		res = fgets(echo, eol_len, ctx->stream);
+		rc = prompt_gets(ctx, echo, eol_len);
 		free(echo);
-		if (!res)
-			return -errno;
+		if (rc < 0)
+			return rc;
 	}
 
 	return rc;
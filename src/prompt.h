@@ -5,21 +5,36 @@
 #define _PROMPT_H
 
 #include <stdbool.h>
-#include <stdio.h>
 #include <sys/types.h>
 
+#define PROMPT_RING_LEN 4096
+
 struct prompt {
-	FILE *stream;
+	int fd;
 	const char *eol;
 	bool have_echo;
+	/* Readable once the exchange should be abandoned, or -1 */
+	int cancel_fd;
+
+	/* Received but not yet consumed, @head and @tail count bytes */
+	char ring[PROMPT_RING_LEN];
+	unsigned long head;
+	unsigned long tail;
 };
 
 /**
- * @param fd Owned, closed on prompt_destroy(), must be mode "r+"
+ * @param fd Owned, closed on prompt_destroy(), must be readable and writable
  */
 int prompt_init(struct prompt *ctx, int fd, const char *eol, bool have_echo);
 int prompt_destroy(struct prompt *ctx);
 
+/*
+ * Fail reads and writes with -ECANCELED once @fd is readable, such as the
+ * eventfd from bridge_probe_cancel_fd(). Reads waiting on the device wake for
+ * it too. Pass -1 to stop. @fd isn't owned.
+ */
+void prompt_set_cancel(struct prompt *ctx, int fd);
+
 int prompt_expect(struct prompt *ctx, const char *str);
 int prompt_expect_into(struct prompt *ctx, const char *str, char *prior,
 		       size_t len, char **prompt);
@@ -27,6 +42,14 @@ ssize_t prompt_write(struct prompt *ctx, const char *cmd, size_t len);
 ssize_t prompt_read(struct prompt *ctx, char *output, size_t len);
 int prompt_gets(struct prompt *ctx, char *output, size_t len);
 
+/*
+ * Expose the received data in place: prompt_peek() returns the contiguous
+ * run at the front of the ring, reading more if it's empty, and
+ * prompt_consume() discards bytes from the front once they've been handled.
+ */
+ssize_t prompt_peek(struct prompt *ctx, const char **data);
+void prompt_consume(struct prompt *ctx, size_t len);
+
 int prompt_run(struct prompt *ctx, const char *cmd);
 int prompt_expect_run(struct prompt *ctx, const char *prompt, const char *cmd);
 int prompt_run_expect(struct prompt *ctx, const char *cmd, const char *prompt,
@@ -0,0 +1,387 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "array.h"
+#include "log.h"
+#include "sio.h"
+#include "simsio.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define SIM_SIO_ADDR 0x2e
+#define SIM_SIO_DATA 0x2f
+
+#define SIO_LDN		 0x07
+#define SIO_ENABLE	 0x30
+#define SIO_BASE_HI	 0x60
+#define SIO_BASE_LO	 0x61
+#define SIO_SIRQ	 0x70
+#define SIO_ILPC_ADDR	 0xf0
+#define SIO_ILPC_DATA	 0xf4
+#define SIO_ILPC_WIDTH	 0xf8
+#define SIO_ILPC_TRIGGER 0xfe
+
+#define SIM_LPC_HICR7 0x1e789088
+#define SIM_LPC_HICR8 0x1e78908c
+
+#define UART_RBR      0x00
+#define UART_IER      0x01
+#define UART_IIR      0x02
+#define UART_FCR      0x02
+#define UART_FCR_RCVR_RST (1 << 1)
+#define UART_LCR      0x03
+#define UART_LCR_DLAB (1 << 7)
+#define UART_MCR      0x04
+#define UART_LSR      0x05
+#define UART_LSR_TEMT (1 << 6)
+#define UART_LSR_THRE (1 << 5)
+#define UART_LSR_OE   (1 << 1)
+#define UART_LSR_DR   (1 << 0)
+#define UART_MSR      0x06
+#define UART_SCR      0x07
+
+/* Hardware defaults for the SUARTs: logical device, I/O base and SIRQ */
+static const struct {
+	uint8_t ldn;
+	uint16_t base;
+	uint8_t sirq;
+} sim_sio_suarts[SIM_SIO_NR_SUART] = {
+	{ sio_suart1, 0x3f8, 4 },
+	{ sio_suart2, 0x2f8, 3 },
+	{ sio_suart3, 0x3e8, 4 },
+	{ sio_suart4, 0x2e8, 3 },
+};
+
+int sim_sio_init(struct sim_sio *ctx, const char *image, const char *soc)
+{
+	size_t i;
+	int rc;
+
+	memset(ctx, 0, sizeof(*ctx));
+
+	if ((rc = sim_soc_init(&ctx->soc, image, soc)) < 0)
+		return rc;
+
+	for (i = 0; i < ARRAY_SIZE(sim_sio_suarts); i++) {
+		uint8_t *regs = ctx->regs[sim_sio_suarts[i].ldn];
+
+		regs[SIO_BASE_HI] = sim_sio_suarts[i].base >> 8;
+		regs[SIO_BASE_LO] = sim_sio_suarts[i].base & 0xff;
+		regs[SIO_SIRQ] = sim_sio_suarts[i].sirq;
+	}
+
+	return 0;
+}
+
+void sim_sio_destroy(struct sim_sio *ctx)
+{
+	sim_soc_destroy(&ctx->soc);
+}
+
+static uint32_t sim_sio_ilpc_width(struct sim_sio *ctx)
+{
+	switch (ctx->regs[sio_ilpc][SIO_ILPC_WIDTH] & 3) {
+	case 0:
+		return 1;
+	case 1:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+static uint32_t sim_sio_ilpc_addr(struct sim_sio *ctx)
+{
+	const uint8_t *regs = ctx->regs[sio_ilpc];
+
+	return (uint32_t)regs[SIO_ILPC_ADDR] << 24 |
+	       (uint32_t)regs[SIO_ILPC_ADDR + 1] << 16 |
+	       (uint32_t)regs[SIO_ILPC_ADDR + 2] << 8 |
+	       (uint32_t)regs[SIO_ILPC_ADDR + 3];
+}
+
+/* Data is held most-significant byte first, right-aligned in 0xf4-0xf7 */
+static void sim_sio_ilpc_read(struct sim_sio *ctx)
+{
+	uint8_t *regs = ctx->regs[sio_ilpc];
+	uint32_t width = sim_sio_ilpc_width(ctx);
+	uint32_t addr = sim_sio_ilpc_addr(ctx);
+	uint8_t buf[4] = { 0 };
+	uint32_t val = 0;
+	uint32_t i;
+
+	if (width == 4) {
+		if (sim_soc_readl(&ctx->soc, addr, &val) < 0)
+			val = ~0;
+	} else {
+		if (sim_soc_read(&ctx->soc, addr, buf, width) < 0)
+			memset(buf, 0xff, sizeof(buf));
+
+		for (i = 0; i < width; i++)
+			val |= (uint32_t)buf[i] << (8 * i);
+	}
+
+	for (i = 0; i < 4; i++)
+		regs[SIO_ILPC_DATA + 3 - i] = val >> (8 * i);
+}
+
+static void sim_sio_ilpc_write(struct sim_sio *ctx)
+{
+	const uint8_t *regs = ctx->regs[sio_ilpc];
+	uint32_t width = sim_sio_ilpc_width(ctx);
+	uint32_t addr = sim_sio_ilpc_addr(ctx);
+	uint8_t buf[4];
+	uint32_t val = 0;
+	uint32_t i;
+
+	for (i = 0; i < width; i++)
+		val |= (uint32_t)regs[SIO_ILPC_DATA + 3 - i] << (8 * i);
+
+	if (width == 4) {
+		sim_soc_writel(&ctx->soc, addr, val);
+		return;
+	}
+
+	for (i = 0; i < width; i++)
+		buf[i] = val >> (8 * i);
+
+	sim_soc_write(&ctx->soc, addr, buf, width);
+}
+
+static uint8_t sim_sio_readb(struct sim_sio *ctx)
+{
+	if (!ctx->unlocked)
+		return 0xff;
+
+	if (ctx->index < 0x30)
+		return ctx->index == SIO_LDN ? ctx->ldn : 0;
+
+	if (ctx->ldn == sio_ilpc && ctx->index == SIO_ILPC_TRIGGER)
+		sim_sio_ilpc_read(ctx);
+
+	return ctx->regs[ctx->ldn][ctx->index];
+}
+
+static void sim_sio_writeb(struct sim_sio *ctx, uint8_t val)
+{
+	if (!ctx->unlocked)
+		return;
+
+	if (ctx->index < 0x30) {
+		if (ctx->index == SIO_LDN)
+			ctx->ldn = val % SIM_SIO_NR_LDN;
+		return;
+	}
+
+	ctx->regs[ctx->ldn][ctx->index] = val;
+
+	if (ctx->ldn == sio_ilpc && ctx->index == SIO_ILPC_TRIGGER)
+		sim_sio_ilpc_write(ctx);
+}
+
+static void sim_sio_select(struct sim_sio *ctx, uint8_t val)
+{
+	/* Two writes of 0xa5 unlock the SuperIO, 0xaa locks it again */
+	if (!ctx->unlocked) {
+		ctx->unlock = val == 0xa5 ? ctx->unlock + 1 : 0;
+		if (ctx->unlock == 2) {
+			ctx->unlocked = true;
+			ctx->unlock = 0;
+		}
+		return;
+	}
+
+	if (val == 0xaa) {
+		ctx->unlocked = false;
+		return;
+	}
+
+	ctx->index = val;
+}
+
+static struct sim_uart *sim_sio_uart(struct sim_sio *ctx, uint16_t port,
+				     uint16_t *reg)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(sim_sio_suarts); i++) {
+		const uint8_t *regs = ctx->regs[sim_sio_suarts[i].ldn];
+		uint16_t base;
+
+		if (!(regs[SIO_ENABLE] & 1))
+			continue;
+
+		base = regs[SIO_BASE_HI] << 8 | regs[SIO_BASE_LO];
+		if (port >= base && port < base + 8) {
+			*reg = port - base;
+			return &ctx->uart[i];
+		}
+	}
+
+	return NULL;
+}
+
+static uint8_t sim_uart_readb(struct sim_uart *uart, uint16_t reg)
+{
+	uint8_t val;
+
+	switch (reg) {
+	case UART_RBR:
+		if (uart->lcr & UART_LCR_DLAB)
+			return uart->dll;
+
+		if (!uart->count)
+			return 0;
+
+		val = uart->fifo[uart->head];
+		uart->head = (uart->head + 1) % SIM_UART_FIFO;
+		uart->count--;
+		return val;
+	case UART_IER:
+		return (uart->lcr & UART_LCR_DLAB) ? uart->dlm : uart->ier;
+	case UART_IIR:
+		/* FIFOs enabled, no interrupt pending */
+		return 0xc1;
+	case UART_LCR:
+		return uart->lcr;
+	case UART_MCR:
+		return uart->mcr;
+	case UART_LSR:
+		val = UART_LSR_TEMT | UART_LSR_THRE;
+		if (uart->count)
+			val |= UART_LSR_DR;
+		if (uart->overrun)
+			val |= UART_LSR_OE;
+		uart->overrun = false;
+		return val;
+	case UART_MSR:
+		return 0;
+	default:
+		return uart->scr;
+	}
+}
+
+static void sim_uart_writeb(struct sim_uart *uart, uint16_t reg, uint8_t val)
+{
+	switch (reg) {
+	case UART_RBR:
+		if (uart->lcr & UART_LCR_DLAB) {
+			uart->dll = val;
+			break;
+		}
+
+		/* Loop the character back to the receiver */
+		if (uart->count == SIM_UART_FIFO) {
+			uart->overrun = true;
+			break;
+		}
+
+		uart->fifo[(uart->head + uart->count) % SIM_UART_FIFO] = val;
+		uart->count++;
+		break;
+	case UART_IER:
+		if (uart->lcr & UART_LCR_DLAB)
+			uart->dlm = val;
+		else
+			uart->ier = val;
+		break;
+	case UART_FCR:
+		if (val & UART_FCR_RCVR_RST) {
+			uart->head = 0;
+			uart->count = 0;
+		}
+		break;
+	case UART_LCR:
+		uart->lcr = val;
+		break;
+	case UART_MCR:
+		uart->mcr = val;
+		break;
+	case UART_SCR:
+		uart->scr = val;
+		break;
+	default:
+		break;
+	}
+}
+
+int sim_sio_inb(struct sim_sio *ctx, uint16_t port, uint8_t *val)
+{
+	struct sim_uart *uart;
+	uint16_t reg;
+
+	if (port == SIM_SIO_ADDR) {
+		*val = ctx->index;
+	} else if (port == SIM_SIO_DATA) {
+		*val = sim_sio_readb(ctx);
+	} else if ((uart = sim_sio_uart(ctx, port, &reg))) {
+		*val = sim_uart_readb(uart, reg);
+	} else {
+		/* Nothing decodes the cycle */
+		*val = 0xff;
+	}
+
+	return 0;
+}
+
+int sim_sio_outb(struct sim_sio *ctx, uint16_t port, uint8_t val)
+{
+	struct sim_uart *uart;
+	uint16_t reg;
+
+	if (port == SIM_SIO_ADDR)
+		sim_sio_select(ctx, val);
+	else if (port == SIM_SIO_DATA)
+		sim_sio_writeb(ctx, val);
+	else if ((uart = sim_sio_uart(ctx, port, &reg)))
+		sim_uart_writeb(uart, reg, val);
+
+	return 0;
+}
+
+/*
+ * HICR7 holds the AHB and LPC bases of the window, and HICR8 the mask of its
+ * size. Cycles outside the LPC base aren't decoded.
+ */
+static bool sim_sio_fw_phys(struct sim_sio *ctx, uint32_t addr, uint32_t *phys)
+{
+	uint32_t hicr7 = 0, hicr8 = 0;
+	uint32_t mask;
+
+	sim_soc_readl(&ctx->soc, SIM_LPC_HICR7, &hicr7);
+	sim_soc_readl(&ctx->soc, SIM_LPC_HICR8, &hicr8);
+
+	mask = hicr8 & 0xffff0000;
+
+	if ((addr & mask) != ((hicr7 << 16) & mask))
+		return false;
+
+	*phys = (hicr7 & mask) | (addr & ~mask);
+
+	return true;
+}
+
+ssize_t sim_sio_fw_read(struct sim_sio *ctx, uint32_t addr, void *buf,
+			size_t len)
+{
+	uint32_t phys;
+
+	/* Nothing drives the bus, so the host reads back all-ones */
+	if (!sim_sio_fw_phys(ctx, addr, &phys)) {
+		memset(buf, 0xff, len);
+		return len;
+	}
+
+	return sim_soc_read(&ctx->soc, phys, buf, len);
+}
+
+ssize_t sim_sio_fw_write(struct sim_sio *ctx, uint32_t addr, const void *buf,
+			 size_t len)
+{
+	uint32_t phys;
+
+	if (!sim_sio_fw_phys(ctx, addr, &phys))
+		return len;
+
+	return sim_soc_write(&ctx->soc, phys, buf, len);
+}
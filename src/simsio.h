@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef _SIMSIO_H
+#define _SIMSIO_H
+
+#include "simsoc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * A model of the host's view of an ASPEED BMC's LPC interface: the SuperIO
+ * at 0x2e with its iLPC2AHB and SUART logical devices, and LPC firmware
+ * cycles decoded to the AHB through HICR7/HICR8. AHB accesses are made
+ * against a struct sim_soc, so an image can be shared with the sim bridge.
+ *
+ * The SUARTs are 16550s that loop transmitted characters back to the
+ * receiver, as if the BMC echoed them.
+ */
+
+#define SIM_SIO_NR_LDN	 0x10
+#define SIM_SIO_NR_SUART 4
+#define SIM_UART_FIFO	 16
+
+struct sim_uart {
+	uint8_t ier;
+	uint8_t lcr;
+	uint8_t mcr;
+	uint8_t scr;
+	uint8_t dll;
+	uint8_t dlm;
+	bool overrun;
+
+	uint8_t fifo[SIM_UART_FIFO];
+	unsigned int head;
+	unsigned int count;
+};
+
+struct sim_sio {
+	struct sim_soc soc;
+
+	unsigned int unlock;
+	bool unlocked;
+	uint8_t index;
+	uint8_t ldn;
+	uint8_t regs[SIM_SIO_NR_LDN][256];
+
+	struct sim_uart uart[SIM_SIO_NR_SUART];
+};
+
+int sim_sio_init(struct sim_sio *ctx, const char *image, const char *soc);
+void sim_sio_destroy(struct sim_sio *ctx);
+
+int sim_sio_inb(struct sim_sio *ctx, uint16_t port, uint8_t *val);
+int sim_sio_outb(struct sim_sio *ctx, uint16_t port, uint8_t val);
+
+ssize_t sim_sio_fw_read(struct sim_sio *ctx, uint32_t addr, void *buf,
+			size_t len);
+ssize_t sim_sio_fw_write(struct sim_sio *ctx, uint32_t addr, const void *buf,
+			 size_t len);
+
+#endif
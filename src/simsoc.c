@@ -0,0 +1,718 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include "array.h"
+#include "bits.h"
+#include "log.h"
+#include "rev.h"
+#include "simsoc.h"
+#include "soc/sfc.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_AHB_SIZE (1ULL << 32)
+
+#define SIM_AHBC	       0x1e600000
+#define AHBC_BCR_CSR	       0x40
+#define AHBC_BCR_CSR_POLL_MODE BIT(1)
+#define AHBC_BCR_CSR_POLL_EN   BIT(0)
+#define AHBC_BCR_BUF	       0x44
+#define AHBC_BCR_BUF_WRAP      BIT(0)
+#define AHBC_BCR_ADDR	       0x48
+#define AHBC_BCR_FIFO_MERGE    0x5c
+
+#define SIM_FMC		  0x1e620000
+#define SIM_FMC_FLASH	  0x20000000
+#define SIM_SPI1	  0x1e630000
+#define SIM_SPI1_FLASH	  0x30000000
+#define SFC_CE_TYPE	  0x00
+#define SFC_CE0_CTRL	  0x10
+#define SFC_CE0_CTRL_STOP BIT(2)
+#define SFC_CE0_CTRL_USER 0x3
+
+#define SIM_SDMC       0x1e6e0000
+#define SDMC_MCR_CONF  0x04
+
+#define SIM_SCU		     0x1e6e2000
+#define SCU_PROT_KEY	     0x00
+#define SCU_PASSWORD	     0x1688a8a8
+#define SCU_SYS_RESET	     0x04
+#define SCU_H_PLL	     0x24
+#define SCU_HW_STRAP	     0x70
+#define SCU_SILICON_REVISION 0x7c
+
+#define SIM_WDT		  0x1e785000
+#define SIM_WDT_STRIDE	  0x20
+#define WDT_STATUS	  0x00
+#define WDT_RELOAD	  0x04
+#define WDT_RESTART	  0x08
+#define WDT_RESTART_MAGIC 0x4755
+#define WDT_CTRL	  0x0c
+#define WDT_CTRL_ENABLE	  BIT(0)
+#define WDT_TIMEOUT	  0x10
+
+#define CMD_WRDI 0x04
+
+/* A 32MiB Winbond W25Q256BV on each of the FMC and SPI1 */
+#define SIM_NOR_ID   0xef4019
+#define SIM_NOR_SIZE (32 << 20)
+
+struct sim_soc_config {
+	const char *name;
+	uint32_t rev;
+	uint32_t strap;
+	uint32_t h_pll;
+	uint32_t mcr_conf;
+};
+
+static const struct sim_soc_config sim_soc_configs[] = {
+	{
+		.name = "ast2400",
+		.rev = 0x02010303,
+		/* 384MHz CPU, HCLK/2 */
+		.strap = 1 << 10,
+		/* 256MiB DRAM, 8MiB VRAM */
+		.mcr_conf = 0b0010,
+	},
+	{
+		.name = "ast2500",
+		.rev = 0x04030303,
+		/* 24MHz CLKIN, 2:1 AXI/AHB ratio */
+		.strap = 1 << 9,
+		/* 792MHz H-PLL, for 198MHz HCLK */
+		.h_pll = 32 << 5,
+		/* 512MiB DRAM, 8MiB VRAM */
+		.mcr_conf = 0b0010,
+	},
+};
+
+static const uint32_t ahbc_bcr_buf_len[] = {
+	4 << 10, 8 << 10, 16 << 10, 32 << 10,
+	128 << 10, 256 << 10, 512 << 10, 1024 << 10,
+};
+
+static inline uint32_t sim_rd32(struct sim_soc *ctx, uint32_t phys)
+{
+	uint32_t val;
+
+	memcpy(&val, ctx->mem + phys, sizeof(val));
+
+	return le32toh(val);
+}
+
+static inline void sim_wr32(struct sim_soc *ctx, uint32_t phys, uint32_t val)
+{
+	val = htole32(val);
+	memcpy(ctx->mem + phys, &val, sizeof(val));
+}
+
+/* Does the access [phys, phys + len) touch the register at reg? */
+static inline bool sim_hit(uint32_t phys, size_t len, uint32_t reg)
+{
+	return (uint64_t)phys < (uint64_t)reg + 4 &&
+	       (uint64_t)reg < (uint64_t)phys + len;
+}
+
+static inline bool sim_within(uint32_t phys, size_t len, uint32_t base,
+			      uint32_t size)
+{
+	return (uint64_t)phys < (uint64_t)base + size &&
+	       (uint64_t)base < (uint64_t)phys + len;
+}
+
+static uint64_t sim_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* SPI-NOR */
+
+static bool sim_nor_has_addr(uint8_t cmd)
+{
+	switch (cmd) {
+	case CMD_READ:
+	case CMD_PP:
+	case CMD_SE:
+	case CMD_BE32K:
+	case CMD_BE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static uint8_t *sim_nor_cell(struct sim_soc *ctx, struct sim_sfc *sfc,
+			     uint32_t addr)
+{
+	return ctx->mem + sfc->flash + (addr & (sfc->nor.size - 1));
+}
+
+static void sim_nor_erase(struct sim_soc *ctx, struct sim_sfc *sfc,
+			  uint32_t addr, uint32_t len)
+{
+	addr &= ~(len - 1);
+	memset(sim_nor_cell(ctx, sfc, addr), 0xff, len);
+	logt("sim: erased 0x%" PRIx32 " bytes at flash offset 0x%" PRIx32
+	     "\n",
+	     len, addr);
+}
+
+static void sim_nor_select(struct sim_sfc *sfc)
+{
+	struct sim_nor *nor = &sfc->nor;
+
+	nor->started = false;
+	nor->nr_addr = 0;
+	nor->addr = 0;
+}
+
+static void sim_nor_deselect(struct sim_soc *ctx, struct sim_sfc *sfc)
+{
+	struct sim_nor *nor = &sfc->nor;
+	bool wen = nor->status & STAT_WEN;
+
+	if (!nor->started)
+		return;
+
+	/* Commands are executed on CE# deassertion */
+	switch (nor->cmd) {
+	case CMD_WREN:
+		nor->status |= STAT_WEN;
+		return;
+	case CMD_EN4B:
+		nor->addr4 = true;
+		return;
+	case CMD_EX4B:
+		nor->addr4 = false;
+		return;
+	case CMD_SE:
+		if (wen && !nor->nr_addr)
+			sim_nor_erase(ctx, sfc, nor->addr, 4 << 10);
+		break;
+	case CMD_BE32K:
+		if (wen && !nor->nr_addr)
+			sim_nor_erase(ctx, sfc, nor->addr, 32 << 10);
+		break;
+	case CMD_BE:
+		if (wen && !nor->nr_addr)
+			sim_nor_erase(ctx, sfc, nor->addr, 64 << 10);
+		break;
+	case CMD_CE:
+	case CMD_MIC_BULK_ERASE:
+		if (wen)
+			sim_nor_erase(ctx, sfc, 0, nor->size);
+		break;
+	case CMD_PP:
+	case CMD_WRSR:
+	case CMD_WRDI:
+		break;
+	default:
+		return;
+	}
+
+	nor->status &= ~STAT_WEN;
+}
+
+static void sim_nor_shift_in(struct sim_soc *ctx, struct sim_sfc *sfc,
+			     uint8_t byte)
+{
+	struct sim_nor *nor = &sfc->nor;
+	uint8_t *cell;
+
+	if (!nor->started) {
+		nor->started = true;
+		nor->cmd = byte;
+		nor->nr_addr = 0;
+		if (sim_nor_has_addr(byte))
+			nor->nr_addr = nor->addr4 ? 4 : 3;
+		return;
+	}
+
+	if (nor->nr_addr) {
+		nor->addr = (nor->addr << 8) | byte;
+		nor->nr_addr--;
+		return;
+	}
+
+	if (nor->cmd != CMD_PP || !(nor->status & STAT_WEN))
+		return;
+
+	/* Programming can only clear bits, and wraps within the page */
+	cell = sim_nor_cell(ctx, sfc, nor->addr);
+	*cell &= byte;
+	nor->addr = (nor->addr & ~0xffU) | ((nor->addr + 1) & 0xff);
+}
+
+static uint8_t sim_nor_shift_out(struct sim_soc *ctx, struct sim_sfc *sfc)
+{
+	struct sim_nor *nor = &sfc->nor;
+	uint8_t byte;
+
+	if (!nor->started || nor->nr_addr)
+		return 0xff;
+
+	switch (nor->cmd) {
+	case CMD_RDID:
+		/* The address is unused, so track the ID byte index instead */
+		if (nor->addr >= 3)
+			return 0;
+		return (nor->id >> (8 * (2 - nor->addr++))) & 0xff;
+	case CMD_RDSR:
+		return nor->status;
+	case CMD_MIC_RDFLST:
+		return 0x80;
+	case CMD_READ:
+		byte = *sim_nor_cell(ctx, sfc, nor->addr);
+		nor->addr = (nor->addr + 1) & (nor->size - 1);
+		return byte;
+	default:
+		return 0xff;
+	}
+}
+
+/* SFC */
+
+static struct sim_sfc *sim_sfc_window(struct sim_soc *ctx, uint32_t phys,
+				      size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(ctx->sfc); i++) {
+		struct sim_sfc *sfc = &ctx->sfc[i];
+
+		if (sim_within(phys, len, sfc->flash, sfc->nor.size))
+			return sfc;
+	}
+
+	return NULL;
+}
+
+static void sim_sfc_update(struct sim_soc *ctx, struct sim_sfc *sfc)
+{
+	uint32_t ctl = sim_rd32(ctx, sfc->iomem + SFC_CE0_CTRL);
+	bool active;
+
+	active = (ctl & SFC_CE0_CTRL_USER) == SFC_CE0_CTRL_USER &&
+		 !(ctl & SFC_CE0_CTRL_STOP);
+
+	if (active && !sfc->active)
+		sim_nor_select(sfc);
+	else if (!active && sfc->active)
+		sim_nor_deselect(ctx, sfc);
+
+	sfc->active = active;
+}
+
+/* AHBC trace buffer */
+
+static void sim_ahbc_push(struct sim_soc *ctx, uint8_t byte)
+{
+	uint32_t csr, buf, ptr, base, len;
+
+	ctx->merge |= (uint32_t)byte << (8 * ctx->merged);
+	sim_wr32(ctx, SIM_AHBC + AHBC_BCR_FIFO_MERGE, ctx->merge);
+
+	if (++ctx->merged < 4)
+		return;
+
+	csr = sim_rd32(ctx, SIM_AHBC + AHBC_BCR_CSR);
+	buf = sim_rd32(ctx, SIM_AHBC + AHBC_BCR_BUF);
+	len = ahbc_bcr_buf_len[(csr >> 8) & 7];
+	ptr = buf & ~3;
+	base = ptr & ~(len - 1);
+
+	sim_wr32(ctx, ptr, ctx->merge);
+
+	ptr += 4;
+	if (ptr - base >= len) {
+		ptr = base;
+		buf |= AHBC_BCR_BUF_WRAP;
+	}
+	sim_wr32(ctx, SIM_AHBC + AHBC_BCR_BUF,
+		 ptr | (buf & AHBC_BCR_BUF_WRAP));
+
+	ctx->merge = 0;
+	ctx->merged = 0;
+}
+
+/*
+ * Only accesses made through the simulated bridge are visible, there's no
+ * model of the BMC's own bus masters.
+ */
+static void sim_ahbc_trace(struct sim_soc *ctx, uint32_t phys,
+			   const uint8_t *data, size_t len, bool write)
+{
+	static const uint8_t styles[][2] = {
+		/* { width, offset } */
+		{ 1, 0 }, { 1, 1 }, { 1, 2 }, { 1, 3 },
+		{ 2, 0 }, { 2, 2 }, { 4, 0 }, { 4, 0 },
+	};
+	uint32_t csr, lane;
+	uint8_t width;
+	size_t i;
+
+	csr = sim_rd32(ctx, SIM_AHBC + AHBC_BCR_CSR);
+	if (!(csr & AHBC_BCR_CSR_POLL_EN))
+		return;
+
+	if (!!(csr & AHBC_BCR_CSR_POLL_MODE) != write)
+		return;
+
+	width = styles[(csr >> 4) & 7][0];
+	lane = (sim_rd32(ctx, SIM_AHBC + AHBC_BCR_ADDR) & ~3) +
+	       styles[(csr >> 4) & 7][1];
+
+	/* Require that the access covers the traced byte lanes */
+	if (lane < phys || (uint64_t)lane + width > (uint64_t)phys + len)
+		return;
+
+	for (i = 0; i < width; i++)
+		sim_ahbc_push(ctx, data[lane - phys + i]);
+}
+
+/* Watchdogs */
+
+static void sim_soc_reset(struct sim_soc *ctx)
+{
+	size_t i;
+
+	logi("sim: Watchdog expired, resetting SoC\n");
+
+	sim_wr32(ctx, SIM_SCU + SCU_PROT_KEY, 0);
+	sim_wr32(ctx, SIM_AHBC + AHBC_BCR_CSR, 0);
+
+	ctx->merge = 0;
+	ctx->merged = 0;
+
+	for (i = 0; i < ARRAY_SIZE(ctx->sfc); i++) {
+		struct sim_sfc *sfc = &ctx->sfc[i];
+
+		sim_wr32(ctx, sfc->iomem + SFC_CE0_CTRL, 0);
+		sfc->active = false;
+		sfc->nor.addr4 = false;
+		sfc->nor.status = 0;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ctx->wdt_expiry); i++) {
+		uint32_t wdt = SIM_WDT + i * SIM_WDT_STRIDE;
+
+		sim_wr32(ctx, wdt + WDT_CTRL, 0);
+		ctx->wdt_expiry[i] = 0;
+	}
+
+	ctx->wdt_armed = false;
+}
+
+static void sim_wdt_poll(struct sim_soc *ctx)
+{
+	uint64_t now;
+	size_t i;
+
+	if (!ctx->wdt_armed)
+		return;
+
+	now = sim_now();
+
+	for (i = 0; i < ARRAY_SIZE(ctx->wdt_expiry); i++) {
+		uint32_t wdt = SIM_WDT + i * SIM_WDT_STRIDE;
+		uint64_t remaining;
+
+		if (!ctx->wdt_expiry[i])
+			continue;
+
+		if (now >= ctx->wdt_expiry[i]) {
+			sim_wr32(ctx, wdt + WDT_TIMEOUT,
+				 sim_rd32(ctx, wdt + WDT_TIMEOUT) + 1);
+			sim_soc_reset(ctx);
+			return;
+		}
+
+		/* The counter ticks at 1MHz */
+		remaining = (ctx->wdt_expiry[i] - now) / 1000;
+		sim_wr32(ctx, wdt + WDT_STATUS, remaining);
+	}
+}
+
+static void sim_wdt_update(struct sim_soc *ctx, uint32_t phys, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(ctx->wdt_expiry); i++) {
+		uint32_t wdt = SIM_WDT + i * SIM_WDT_STRIDE;
+		uint32_t reload = sim_rd32(ctx, wdt + WDT_RELOAD);
+		bool enabled = sim_rd32(ctx, wdt + WDT_CTRL) & WDT_CTRL_ENABLE;
+		bool restart = false;
+
+		if (sim_hit(phys, len, wdt + WDT_RESTART))
+			restart = sim_rd32(ctx, wdt + WDT_RESTART) ==
+				  WDT_RESTART_MAGIC;
+
+		if (sim_hit(phys, len, wdt + WDT_CTRL))
+			restart |= enabled && !ctx->wdt_expiry[i];
+
+		if (!enabled) {
+			ctx->wdt_expiry[i] = 0;
+			sim_wr32(ctx, wdt + WDT_STATUS, reload);
+		} else if (restart) {
+			ctx->wdt_expiry[i] = sim_now() + reload * 1000ULL;
+			sim_wr32(ctx, wdt + WDT_STATUS, reload);
+		}
+	}
+
+	ctx->wdt_armed = false;
+	for (i = 0; i < ARRAY_SIZE(ctx->wdt_expiry); i++)
+		ctx->wdt_armed |= !!ctx->wdt_expiry[i];
+}
+
+/* Register side-effects of a completed write to plain memory */
+static void sim_soc_update(struct sim_soc *ctx, uint32_t phys, size_t len)
+{
+	size_t i;
+
+	if (sim_hit(phys, len, SIM_SCU + SCU_PROT_KEY)) {
+		uint32_t key = sim_rd32(ctx, SIM_SCU + SCU_PROT_KEY);
+
+		sim_wr32(ctx, SIM_SCU + SCU_PROT_KEY, key == SCU_PASSWORD);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ctx->sfc); i++) {
+		struct sim_sfc *sfc = &ctx->sfc[i];
+
+		if (sim_hit(phys, len, sfc->iomem + SFC_CE0_CTRL))
+			sim_sfc_update(ctx, sfc);
+	}
+
+	if (sim_within(phys, len, SIM_WDT, SIM_NR_WDT * SIM_WDT_STRIDE))
+		sim_wdt_update(ctx, phys, len);
+
+	if (sim_hit(phys, len, SIM_AHBC + AHBC_BCR_CSR)) {
+		uint32_t csr = sim_rd32(ctx, SIM_AHBC + AHBC_BCR_CSR);
+
+		if (!(csr & AHBC_BCR_CSR_POLL_EN)) {
+			ctx->merge = 0;
+			ctx->merged = 0;
+		}
+	}
+
+	/* The wrap bit reports status, writing the pointer clears it */
+	if (sim_hit(phys, len, SIM_AHBC + AHBC_BCR_BUF)) {
+		uint32_t buf = sim_rd32(ctx, SIM_AHBC + AHBC_BCR_BUF);
+
+		sim_wr32(ctx, SIM_AHBC + AHBC_BCR_BUF,
+			 buf & ~AHBC_BCR_BUF_WRAP);
+	}
+}
+
+ssize_t sim_soc_read(struct sim_soc *ctx, uint32_t phys, void *buf, size_t len)
+{
+	struct sim_sfc *sfc;
+	uint8_t *data = buf;
+	size_t i;
+
+	if ((uint64_t)phys + len > SIM_AHB_SIZE)
+		return -EINVAL;
+
+	sim_wdt_poll(ctx);
+
+	sfc = sim_sfc_window(ctx, phys, len);
+	if (sfc && sfc->active) {
+		/* Each byte of the access clocks a byte out of the flash */
+		for (i = 0; i < len; i++)
+			data[i] = sim_nor_shift_out(ctx, sfc);
+	} else {
+		memcpy(buf, ctx->mem + phys, len);
+	}
+
+	sim_ahbc_trace(ctx, phys, buf, len, false);
+
+	return len;
+}
+
+ssize_t sim_soc_write(struct sim_soc *ctx, uint32_t phys, const void *buf,
+		      size_t len)
+{
+	const uint8_t *data = buf;
+	struct sim_sfc *sfc;
+	size_t i;
+
+	if ((uint64_t)phys + len > SIM_AHB_SIZE)
+		return -EINVAL;
+
+	sim_wdt_poll(ctx);
+
+	sfc = sim_sfc_window(ctx, phys, len);
+	if (sfc) {
+		/* Writes to the flash window outside of user mode are dropped */
+		for (i = 0; sfc->active && i < len; i++)
+			sim_nor_shift_in(ctx, sfc, data[i]);
+	} else {
+		memcpy(ctx->mem + phys, buf, len);
+		sim_soc_update(ctx, phys, len);
+	}
+
+	sim_ahbc_trace(ctx, phys, buf, len, true);
+
+	return len;
+}
+
+int sim_soc_readl(struct sim_soc *ctx, uint32_t phys, uint32_t *val)
+{
+	uint32_t container;
+	ssize_t rc;
+
+	if (phys & 3)
+		return -EINVAL;
+
+	if ((rc = sim_soc_read(ctx, phys, &container, sizeof(container))) < 0)
+		return rc;
+
+	*val = le32toh(container);
+
+	return 0;
+}
+
+int sim_soc_writel(struct sim_soc *ctx, uint32_t phys, uint32_t val)
+{
+	ssize_t rc;
+
+	if (phys & 3)
+		return -EINVAL;
+
+	val = htole32(val);
+	if ((rc = sim_soc_write(ctx, phys, &val, sizeof(val))) < 0)
+		return rc;
+
+	return 0;
+}
+
+static void sim_soc_power_on(struct sim_soc *ctx,
+			     const struct sim_soc_config *config)
+{
+	size_t i;
+
+	logi("sim: Initialising fresh %s image\n", config->name);
+
+	sim_wr32(ctx, SIM_SCU + SCU_SYS_RESET, 0xfffffffc);
+	sim_wr32(ctx, SIM_SCU + SCU_H_PLL, config->h_pll);
+	sim_wr32(ctx, SIM_SCU + SCU_HW_STRAP, config->strap);
+	sim_wr32(ctx, SIM_SDMC + SDMC_MCR_CONF, config->mcr_conf);
+
+	for (i = 0; i < ARRAY_SIZE(ctx->sfc); i++) {
+		struct sim_sfc *sfc = &ctx->sfc[i];
+
+		sim_wr32(ctx, sfc->iomem + SFC_CE_TYPE, 0x2a);
+		memset(ctx->mem + sfc->flash, 0xff, sfc->nor.size);
+	}
+
+	for (i = 0; i < SIM_NR_WDT; i++)
+		sim_wr32(ctx, SIM_WDT + i * SIM_WDT_STRIDE + WDT_RELOAD,
+			 0x03291750);
+}
+
+int sim_soc_init(struct sim_soc *ctx, const char *image, const char *soc)
+{
+	static const uint32_t sfcs[SIM_NR_SFC][2] = {
+		{ SIM_FMC, SIM_FMC_FLASH },
+		{ SIM_SPI1, SIM_SPI1_FLASH },
+	};
+	const struct sim_soc_config *config = NULL;
+	struct stat statbuf;
+	size_t i;
+	int rc;
+
+#if SIZE_MAX <= UINT32_MAX
+	loge("sim: A 64-bit host is required to map the AHB address space\n");
+	return -ENOTSUP;
+#endif
+
+	for (i = 0; i < ARRAY_SIZE(sim_soc_configs); i++) {
+		if (!strcmp(soc, sim_soc_configs[i].name))
+			config = &sim_soc_configs[i];
+	}
+
+	if (!config) {
+		loge("sim: Unsupported SoC '%s'\n", soc);
+		return -EINVAL;
+	}
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->rev = config->rev;
+
+	ctx->fd = open(image, O_RDWR | O_CREAT, 0644);
+	if (ctx->fd < 0) {
+		rc = -errno;
+		loge("sim: Failed to open image '%s': %d\n", image, rc);
+		return rc;
+	}
+
+	if (fstat(ctx->fd, &statbuf) < 0) {
+		rc = -errno;
+		goto cleanup_fd;
+	}
+
+	/* Sparse, so only the regions we touch consume space */
+	if ((uint64_t)statbuf.st_size < SIM_AHB_SIZE) {
+		if (ftruncate(ctx->fd, (off_t)SIM_AHB_SIZE) < 0) {
+			rc = -errno;
+			goto cleanup_fd;
+		}
+	}
+
+	ctx->mem = mmap(NULL, (size_t)SIM_AHB_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED, ctx->fd, 0);
+	if (ctx->mem == MAP_FAILED) {
+		rc = -errno;
+		goto cleanup_fd;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ctx->sfc); i++) {
+		struct sim_sfc *sfc = &ctx->sfc[i];
+
+		sfc->iomem = sfcs[i][0];
+		sfc->flash = sfcs[i][1];
+		sfc->nor.id = SIM_NOR_ID;
+		sfc->nor.size = SIM_NOR_SIZE;
+	}
+
+	if (!sim_rd32(ctx, SIM_SCU + SCU_SILICON_REVISION))
+		sim_soc_power_on(ctx, config);
+
+	/* Read-only, so always reflect the requested SoC */
+	sim_wr32(ctx, SIM_SCU + SCU_SILICON_REVISION, ctx->rev);
+
+	/* Pick up any user-mode state left in the image */
+	for (i = 0; i < ARRAY_SIZE(ctx->sfc); i++)
+		sim_sfc_update(ctx, &ctx->sfc[i]);
+
+	logd("sim: Mapped %s as %s (0x%" PRIx32 ")\n", image,
+	     rev_name(ctx->rev), ctx->rev);
+
+	return 0;
+
+cleanup_fd:
+	close(ctx->fd);
+
+	return rc;
+}
+
+void sim_soc_destroy(struct sim_soc *ctx)
+{
+	if (munmap(ctx->mem, (size_t)SIM_AHB_SIZE) < 0)
+		perror("munmap");
+
+	if (close(ctx->fd) < 0)
+		perror("close");
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef _SIMSOC_H
+#define _SIMSOC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * A model of an ASPEED BMC's AHB, backed by a sparse 4GiB image file mapped
+ * into the process. Offsets in the image are AHB physical addresses, so e.g.
+ * firmware can be loaded by writing it at the FMC flash window (0x20000000).
+ *
+ * Plain memory semantics apply everywhere except for the registers that
+ * culvert depends on for correct behaviour: the SCU protection key and
+ * revision registers, the SFC user-mode command interface (with a SPI-NOR
+ * model behind it), the watchdogs and the AHBC trace buffer.
+ */
+
+#define SIM_NR_SFC 2
+#define SIM_NR_WDT 3
+
+struct sim_nor {
+	uint32_t id;
+	uint32_t size;
+	uint8_t status;
+	bool addr4;
+
+	/* User-mode command state, reset on each CE# assertion */
+	bool started;
+	uint8_t cmd;
+	unsigned int nr_addr;
+	uint32_t addr;
+};
+
+struct sim_sfc {
+	uint32_t iomem;
+	uint32_t flash;
+	bool active;
+	struct sim_nor nor;
+};
+
+struct sim_soc {
+	int fd;
+	uint8_t *mem;
+	uint32_t rev;
+
+	struct sim_sfc sfc[SIM_NR_SFC];
+
+	/* Watchdog expiry times (CLOCK_MONOTONIC, ns), 0 if disarmed */
+	uint64_t wdt_expiry[SIM_NR_WDT];
+	bool wdt_armed;
+
+	/* AHBC trace merge FIFO */
+	uint32_t merge;
+	unsigned int merged;
+};
+
+int sim_soc_init(struct sim_soc *ctx, const char *image, const char *soc);
+void sim_soc_destroy(struct sim_soc *ctx);
+
+ssize_t sim_soc_read(struct sim_soc *ctx, uint32_t phys, void *buf,
+		     size_t len);
+ssize_t sim_soc_write(struct sim_soc *ctx, uint32_t phys, const void *buf,
+		      size_t len);
+int sim_soc_readl(struct sim_soc *ctx, uint32_t phys, uint32_t *val);
+int sim_soc_writel(struct sim_soc *ctx, uint32_t phys, uint32_t val);
+
+#endif
@@ -1,20 +1,110 @@
 // SPDX-License-Identifier: Apache-2.0
 // Copyright (C) 2018,2019 IBM Corp.
 
+#include "array.h"
 #include "log.h"
 #include "sio.h"
 
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define SIO_ADDR(ctx) ((ctx)->base)
 #define SIO_DATA(ctx) ((ctx)->base + 1)
 
+/* Remembers the outcome of the last probe until the host reboots, if asked */
+#define SIO_STATE_DIR  "/run/culvert"
+#define SIO_STATE_PATH SIO_STATE_DIR "/sio"
+
+static const char *sio_state_path;
+
+/* The base found by sio_probe(): 0 if the SuperIO is disabled, -1 if unknown */
+static int sio_base = -1;
+
+void sio_set_state_path(const char *path)
+{
+	sio_state_path = path ?: SIO_STATE_PATH;
+}
+
+/*
+ * The state file holds the LPC backend's name and the base, so a simulated
+ * SuperIO doesn't stand in for the real one. Returns the base, 0 if the
+ * SuperIO was found to be disabled, or -1 if nothing is known.
+ */
+static int sio_state_load(struct sio *ctx)
+{
+	char backend[32];
+	unsigned int base;
+	FILE *state;
+	int rc;
+
+	if (!sio_state_path || !(state = fopen(sio_state_path, "re")))
+		return -1;
+
+	rc = fscanf(state, "%31s %x", backend, &base);
+	fclose(state);
+
+	if (rc != 2 || strcmp(backend, ctx->io.backend->name))
+		return -1;
+
+	if (base && base != 0x2e && base != 0x4e)
+		return -1;
+
+	return base;
+}
+
+static void sio_state_store(struct sio *ctx, int base)
+{
+	char path[PATH_MAX];
+	FILE *state;
+
+	if (!sio_state_path)
+		return;
+
+	if (!strcmp(sio_state_path, SIO_STATE_PATH) &&
+	    mkdir(SIO_STATE_DIR, 0755) && errno != EEXIST)
+		return;
+
+	snprintf(path, sizeof(path), "%s.%d", sio_state_path, getpid());
+	if (!(state = fopen(path, "we")))
+		return;
+
+	fprintf(state, "%s 0x%x\n", ctx->io.backend->name, base);
+
+	/* Swap it in whole so a concurrent culvert never sees it half-written */
+	if (fclose(state) || rename(path, sio_state_path)) {
+		logd("Failed to record SuperIO state: %d\n", -errno);
+		unlink(path);
+	}
+}
+
+void sio_forget(void)
+{
+	sio_base = -1;
+	if (sio_state_path)
+		unlink(sio_state_path);
+}
+
 int sio_init(struct sio *ctx)
 {
-	ctx->base = 0x2e;
-	return lpc_init(&ctx->io, "io");
+	int rc;
+
+	if ((rc = lpc_init(&ctx->io, "io")))
+		return rc;
+
+	/*
+	 * Only trust a base this process has probed, as the BMC may have been
+	 * reconfigured since the state file was written. Otherwise assume the
+	 * default.
+	 */
+	ctx->base = sio_base > 0 ? sio_base : 0x2e;
+
+	return 0;
 }
 
 int sio_destroy(struct sio *ctx)
@@ -22,17 +112,33 @@ int sio_destroy(struct sio *ctx)
 	return lpc_destroy(&ctx->io);
 }
 
+/*
+ * Writes are queued with the LPC backend and issued along with the next read,
+ * or at the latest when the SuperIO is locked again. Use sio_flush() where
+ * they must land sooner.
+ */
+int sio_flush(struct sio *ctx)
+{
+	return lpc_flush(&ctx->io);
+}
+
 int sio_lock(struct sio *ctx)
 {
-	return lpc_writeb(&ctx->io, SIO_ADDR(ctx), 0xaa);
+	int rc;
+
+	rc = lpc_queue_writeb(&ctx->io, SIO_ADDR(ctx), 0xaa);
+	if (rc)
+		return rc;
+
+	return sio_flush(ctx);
 }
 
 int sio_unlock(struct sio *ctx)
 {
 	int rc;
 
-	rc = lpc_writeb(&ctx->io, SIO_ADDR(ctx), 0xa5);
-	rc |= lpc_writeb(&ctx->io, SIO_ADDR(ctx), 0xa5);
+	rc = lpc_queue_writeb(&ctx->io, SIO_ADDR(ctx), 0xa5);
+	rc |= lpc_queue_writeb(&ctx->io, SIO_ADDR(ctx), 0xa5);
 
 	return rc;
 }
@@ -90,42 +196,89 @@ out:
 
 int sio_probe(struct sio *ctx)
 {
-	bool found;
+	uint16_t bases[] = { 0x2e, 0x4e };
+	int err = 0;
+	int hint;
+	size_t i;
+	int rc;
+
+	if (sio_base > 0) {
+		ctx->base = sio_base;
+		logd("Found SuperIO device at 0x%" PRIx16 " (cached)\n",
+		     ctx->base);
+		return 1;
+	} else if (!sio_base) {
+		logd("SuperIO disabled (cached)\n");
+		return 0;
+	}
+
+	/*
+	 * The BMC may have been reconfigured since an earlier process probed
+	 * the SuperIO, so only use the recorded base to decide where to look
+	 * first.
+	 */
+	hint = sio_state_load(ctx);
+	if (hint == 0x4e) {
+		bases[0] = 0x4e;
+		bases[1] = 0x2e;
+	}
 
-	ctx->base = 0x2e;
-	found = sio_present(ctx);
-	if (!found) {
-		ctx->base = 0x4e;
-		found = sio_present(ctx);
+	for (i = 0; i < ARRAY_SIZE(bases); i++) {
+		ctx->base = bases[i];
+		rc = sio_present(ctx);
+		if (rc > 0)
+			break;
+		if (rc < 0)
+			err = rc;
 	}
 
-	if (found) {
+	if (i < ARRAY_SIZE(bases)) {
 		logd("Found SuperIO device at 0x%" PRIx16 "\n", ctx->base);
-	} else {
+		sio_base = ctx->base;
+	} else if (!err) {
 		logd("SuperIO disabled\n");
+		sio_base = 0;
+	} else {
+		/* Don't remember a result we couldn't be sure of */
+		logd("Failed to probe for SuperIO: %d\n", err);
+		return 0;
 	}
 
-	return found;
+	if (hint != sio_base)
+		sio_state_store(ctx, sio_base);
+
+	return !!sio_base;
+}
+
+int sio_queue_readb(struct sio *ctx, uint32_t addr, uint8_t *val)
+{
+	int rc;
+
+	rc = lpc_queue_writeb(&ctx->io, SIO_ADDR(ctx), addr);
+	if (rc)
+		return rc;
+
+	return lpc_queue_readb(&ctx->io, SIO_DATA(ctx), val);
 }
 
 int sio_readb(struct sio *ctx, uint32_t addr, uint8_t *val)
 {
 	int rc;
 
-	rc = lpc_writeb(&ctx->io, SIO_ADDR(ctx), addr);
+	rc = sio_queue_readb(ctx, addr, val);
 	if (rc)
 		return rc;
 
-	return lpc_readb(&ctx->io, SIO_DATA(ctx), val);
+	return sio_flush(ctx);
 }
 
 int sio_writeb(struct sio *ctx, uint32_t addr, uint8_t val)
 {
 	int rc;
 
-	rc = lpc_writeb(&ctx->io, SIO_ADDR(ctx), addr);
+	rc = lpc_queue_writeb(&ctx->io, SIO_ADDR(ctx), addr);
 	if (rc)
 		return rc;
 
-	return lpc_writeb(&ctx->io, SIO_DATA(ctx), val);
+	return lpc_queue_writeb(&ctx->io, SIO_DATA(ctx), val);
 }
@@ -30,8 +30,24 @@ int sio_destroy(struct sio *ctx);
 int sio_lock(struct sio *ctx);
 int sio_unlock(struct sio *ctx);
 int sio_select(struct sio *ctx, enum sio_dev dev);
+/*
+ * Returns 1 and sets the base if the SuperIO is found. The result is cached
+ * for the life of the process, and hints later processes where to look first
+ * if sio_set_state_path() was called.
+ */
 int sio_probe(struct sio *ctx);
+/* Discard the cached probe result, e.g. once the SuperIO's decoding changes */
+void sio_forget(void);
+/*
+ * Opt in to recording the probe result in @path, or /run/culvert/sio if NULL,
+ * to hint later processes where to look first
+ */
+void sio_set_state_path(const char *path);
 int sio_readb(struct sio *ctx, uint32_t addr, uint8_t *val);
 int sio_writeb(struct sio *ctx, uint32_t addr, uint8_t val);
 
+/* Queue a read, storing through @val no later than the next sio_flush() */
+int sio_queue_readb(struct sio *ctx, uint32_t addr, uint8_t *val);
+int sio_flush(struct sio *ctx);
+
 #endif
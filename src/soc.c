@@ -70,6 +70,7 @@ int soc_from_rev(struct soc *ctx, struct ahb *ahb, uint32_t rev)
 	ctx->ahb = ahb;
 	list_head_init(&ctx->devices);
 	list_head_init(&ctx->bridges);
+	list_head_init(&ctx->caches);
 	return soc_align_fdt(ctx, &soc_fdts[rev_generation(rev)]);
 }
 
@@ -222,13 +223,220 @@ int soc_probe(struct soc *ctx, struct ahb *ahb)
 	return 0;
 }
 
+static void soc_cache_destroy(struct soc *ctx);
+
 void soc_destroy(struct soc *ctx)
 {
 	soc_unbind_drivers(ctx);
 
+	/* Drivers may still access their registers while unbinding */
+	soc_cache_destroy(ctx);
+
 	free(ctx->fdt.start);
 }
 
+/* The BMC may change registers under us, so caching must be asked for */
+static bool soc_caching;
+
+void soc_set_caching(bool enable)
+{
+	soc_caching = enable;
+}
+
+struct soc_cache {
+	struct list_node entry;
+	struct soc_region region;
+	const struct soc_cache_range *volatiles;
+	size_t n_volatiles;
+	unsigned long generation;
+	uint32_t *vals;
+	bool *valid;
+};
+
+int soc_cache_region(struct soc *ctx, const struct soc_region *region,
+		     const struct soc_cache_range *volatiles,
+		     size_t n_volatiles)
+{
+	struct soc_cache *cache;
+	size_t n_regs;
+
+	if (!soc_caching)
+		return 0;
+
+	if ((region->start & 3) || (region->length & 3) || !region->length)
+		return -EINVAL;
+
+	list_for_each(&ctx->caches, cache, entry) {
+		if (cache->region.start == region->start &&
+		    cache->region.length == region->length)
+			return 0;
+
+		if (region->start < cache->region.start + cache->region.length &&
+		    cache->region.start < region->start + region->length)
+			return -EEXIST;
+	}
+
+	n_regs = region->length / 4;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return -ENOMEM;
+
+	cache->vals = calloc(n_regs, sizeof(*cache->vals));
+	cache->valid = calloc(n_regs, sizeof(*cache->valid));
+	if (!cache->vals || !cache->valid) {
+		free(cache->valid);
+		free(cache->vals);
+		free(cache);
+		return -ENOMEM;
+	}
+
+	cache->region = *region;
+	cache->volatiles = volatiles;
+	cache->n_volatiles = n_volatiles;
+	cache->generation = ctx->ahb->generation;
+
+	list_add_tail(&ctx->caches, &cache->entry);
+
+	logd("Caching registers in [0x%08" PRIx32 ", 0x%08" PRIx32 ")\n",
+	     region->start, region->start + region->length);
+
+	return 0;
+}
+
+static void soc_cache_destroy(struct soc *ctx)
+{
+	struct soc_cache *cache, *next;
+
+	list_for_each_safe(&ctx->caches, cache, next, entry) {
+		list_del(&cache->entry);
+		free(cache->valid);
+		free(cache->vals);
+		free(cache);
+	}
+}
+
+static void soc_cache_flush(struct soc_cache *cache)
+{
+	memset(cache->valid, 0,
+	       (cache->region.length / 4) * sizeof(*cache->valid));
+}
+
+static struct soc_cache *soc_cache_find(struct soc *ctx, uint32_t phys)
+{
+	struct soc_cache *cache;
+
+	list_for_each(&ctx->caches, cache, entry) {
+		if (phys - cache->region.start >= cache->region.length)
+			continue;
+
+		/* Nothing survives the bridge being released */
+		if (cache->generation != ctx->ahb->generation) {
+			soc_cache_flush(cache);
+			cache->generation = ctx->ahb->generation;
+		}
+
+		return cache;
+	}
+
+	return NULL;
+}
+
+static bool soc_cache_is_volatile(const struct soc_cache *cache,
+				  uint32_t offset)
+{
+	size_t i;
+
+	for (i = 0; i < cache->n_volatiles; i++) {
+		if (offset >= cache->volatiles[i].start &&
+		    offset < cache->volatiles[i].end)
+			return true;
+	}
+
+	return false;
+}
+
+int soc_cache_readl(struct soc *ctx, uint32_t phys, uint32_t *val)
+{
+	struct soc_cache *cache;
+	uint32_t offset;
+	int rc;
+
+	cache = soc_cache_find(ctx, phys);
+	if (!cache || (phys & 3))
+		return ahb_readl(ctx->ahb, phys, val);
+
+	offset = phys - cache->region.start;
+	if (soc_cache_is_volatile(cache, offset))
+		return ahb_readl(ctx->ahb, phys, val);
+
+	if (cache->valid[offset / 4]) {
+		*val = cache->vals[offset / 4];
+		logt("%s: 0x%08" PRIx32 ": 0x%08" PRIx32 " (cached)\n",
+		     __func__, phys, *val);
+		return 0;
+	}
+
+	if ((rc = ahb_readl(ctx->ahb, phys, val)) < 0)
+		return rc;
+
+	cache->vals[offset / 4] = *val;
+	cache->valid[offset / 4] = true;
+
+	return 0;
+}
+
+int soc_cache_writel(struct soc *ctx, uint32_t phys, uint32_t val)
+{
+	struct soc_cache *cache;
+	uint32_t offset;
+	int rc;
+
+	cache = soc_cache_find(ctx, phys);
+	if (!cache || (phys & 3))
+		return ahb_writel(ctx->ahb, phys, val);
+
+	offset = phys - cache->region.start;
+	rc = ahb_writel(ctx->ahb, phys, val);
+
+	if (soc_cache_is_volatile(cache, offset)) {
+		soc_cache_flush(cache);
+		return rc;
+	}
+
+	/* Write-through, and on failure we can't know what the register holds */
+	cache->vals[offset / 4] = val;
+	cache->valid[offset / 4] = !rc;
+
+	return rc;
+}
+
+void soc_cache_invalidate(struct soc *ctx, uint32_t phys, size_t len)
+{
+	uint64_t start, end, offset;
+	struct soc_cache *cache;
+
+	list_for_each(&ctx->caches, cache, entry) {
+		start = phys > cache->region.start ? phys : cache->region.start;
+		end = (uint64_t)cache->region.start + cache->region.length;
+		if ((uint64_t)phys + len < end)
+			end = (uint64_t)phys + len;
+
+		if (start >= end)
+			continue;
+
+		for (offset = (start - cache->region.start) & ~3ULL;
+		     offset < end - cache->region.start; offset += 4) {
+			if (soc_cache_is_volatile(cache, offset)) {
+				soc_cache_flush(cache);
+				break;
+			}
+
+			cache->valid[offset / 4] = false;
+		}
+	}
+}
+
 int soc_device_match_node(struct soc *ctx, const struct soc_device_id table[],
 			  struct soc_device_node *dn)
 {
@@ -496,6 +704,53 @@ int soc_device_get_memory_region_named(struct soc *ctx,
 	return soc_device_get_memory(ctx, &rdn, region);
 }
 
+int soc_device_get_regions(struct soc *ctx, struct soc_device_region **regions,
+			   size_t *n_regions)
+{
+	struct soc_device_region *found = NULL, *tmp;
+	struct soc_device_node dn;
+	int node, depth = 0;
+	size_t n = 0;
+	int len, i;
+	int rc;
+
+	for (node = fdt_next_node(ctx->fdt.start, -1, &depth); node >= 0;
+	     node = fdt_next_node(ctx->fdt.start, node, &depth)) {
+		if (!fdt_getprop(ctx->fdt.start, node, "reg", &len))
+			continue;
+
+		dn.fdt = &ctx->fdt;
+		dn.offset = node;
+
+		for (i = 0; i < len / 8; i++) {
+			tmp = realloc(found, (n + 1) * sizeof(*found));
+			if (!tmp) {
+				rc = -ENOMEM;
+				goto cleanup_found;
+			}
+			found = tmp;
+
+			rc = soc_device_get_memory_index(ctx, &dn, i,
+							 &found[n].region);
+			if (rc < 0)
+				goto cleanup_found;
+
+			found[n].name = fdt_get_name(ctx->fdt.start, node, NULL);
+			n++;
+		}
+	}
+
+	*regions = found;
+	*n_regions = n;
+
+	return 0;
+
+cleanup_found:
+	free(found);
+
+	return rc;
+}
+
 static void *soc_device_init_driver(struct soc *ctx, struct soc_device *dev)
 
 {
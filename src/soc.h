@@ -19,16 +19,25 @@ struct soc_fdt {
 	void *end;
 };
 
+struct soc_region {
+	uint32_t start;
+	uint32_t length;
+};
+
 struct soc {
 	uint32_t rev;
 	struct soc_fdt fdt;
 	struct ahb *ahb;
 	struct list_head devices;
 	struct list_head bridges;
+	struct list_head caches;
 };
 
 int soc_probe(struct soc *ctx, struct ahb *ahb);
 
+/* Describe the SoC for @rev without probing it or binding drivers */
+int soc_from_rev(struct soc *ctx, struct ahb *ahb, uint32_t rev);
+
 void soc_destroy(struct soc *ctx);
 
 static inline enum ast_generation soc_generation(struct soc *ctx)
@@ -41,6 +50,33 @@ static inline int soc_stepping(struct soc *ctx)
 	return rev_stepping(ctx->rev);
 }
 
+/* Offsets into a cached region, with @end exclusive */
+struct soc_cache_range {
+	uint32_t start;
+	uint32_t end;
+};
+
+/*
+ * Enable caching for regions opted in by drivers. It's off by default: a live
+ * BMC may change cached registers mid-command, and read-modify-write sequences
+ * would then write its changes back with stale values.
+ */
+void soc_set_caching(bool enable);
+
+/*
+ * Opt @region in to caching its registers if caching is enabled. Accesses to
+ * @volatiles always reach the bridge, and writes to them invalidate the whole
+ * region as they may have side-effects elsewhere (W1C, set/clear pairs,
+ * protection keys). Registers updated by the hardware must be volatile.
+ */
+int soc_cache_region(struct soc *ctx, const struct soc_region *region,
+		     const struct soc_cache_range *volatiles,
+		     size_t n_volatiles);
+void soc_cache_invalidate(struct soc *ctx, uint32_t phys, size_t len);
+
+int soc_cache_readl(struct soc *ctx, uint32_t phys, uint32_t *val);
+int soc_cache_writel(struct soc *ctx, uint32_t phys, uint32_t val);
+
 static inline ssize_t soc_read(struct soc *ctx, uint32_t phys, void *buf,
 			       size_t len)
 {
@@ -50,19 +86,46 @@ static inline ssize_t soc_read(struct soc *ctx, uint32_t phys, void *buf,
 static inline ssize_t soc_write(struct soc *ctx, uint32_t phys, const void *buf,
 				size_t len)
 {
+	if (!list_empty(&ctx->caches))
+		soc_cache_invalidate(ctx, phys, len);
+
 	return ahb_write(ctx->ahb, phys, buf, len);
 }
 
 static inline int soc_readl(struct soc *ctx, uint32_t phys, uint32_t *val)
 {
+	if (!list_empty(&ctx->caches))
+		return soc_cache_readl(ctx, phys, val);
+
 	return ahb_readl(ctx->ahb, phys, val);
 }
 
 static inline int soc_writel(struct soc *ctx, uint32_t phys, uint32_t val)
 {
+	if (!list_empty(&ctx->caches))
+		return soc_cache_writel(ctx, phys, val);
+
 	return ahb_writel(ctx->ahb, phys, val);
 }
 
+static inline int soc_readv(struct soc *ctx, struct ahb_vec *vec, size_t n)
+{
+	return ahb_readv(ctx->ahb, vec, n);
+}
+
+static inline int soc_writev(struct soc *ctx, const struct ahb_vec *vec,
+			     size_t n)
+{
+	size_t i;
+
+	if (!list_empty(&ctx->caches)) {
+		for (i = 0; i < n; i++)
+			soc_cache_invalidate(ctx, vec[i].phys, vec[i].width);
+	}
+
+	return ahb_writev(ctx->ahb, vec, n);
+}
+
 static inline ssize_t soc_siphon_out(struct soc *ctx, uint32_t phys, size_t len,
 				     int outfd)
 {
@@ -122,11 +185,6 @@ const void *soc_device_get_match_data(struct soc *ctx,
 				      const struct soc_device_id table[],
 				      const struct soc_device_node *dn);
 
-struct soc_region {
-	uint32_t start;
-	uint32_t length;
-};
-
 int soc_device_get_memory_index(struct soc *ctx,
 				const struct soc_device_node *dn, int index,
 				struct soc_region *region);
@@ -143,6 +201,15 @@ int soc_device_get_memory_region_named(struct soc *ctx,
 				       const char *name,
 				       struct soc_region *region);
 
+struct soc_device_region {
+	const char *name;
+	struct soc_region region;
+};
+
+/* Collect every memory region described by the devicetree, caller frees */
+int soc_device_get_regions(struct soc *ctx, struct soc_device_region **regions,
+			   size_t *n_regions);
+
 struct soc_driver {
 	const char *name;
 	const struct soc_device_id *matches;
@@ -3,6 +3,7 @@
 
 #include "compiler.h"
 
+#include "array.h"
 #include "bits.h"
 #include "clk.h"
 #include "scu.h"
@@ -123,24 +124,25 @@ int64_t ast2400_clk_rate_ahb(struct clk *ctx)
 	return cpu_clk / div;
 }
 
-int ast2400_clk_disable(struct clk *ctx, enum clksrc src)
+static int scu_update_uart3(struct clk *ctx, uint32_t val)
 {
-	uint32_t reg;
-	int rc;
+	struct ahb_vec update = {
+		.phys = SCU_CLK_STOP,
+		.width = 4,
+		.val = val,
+		.mask = SCU_CLK_STOP_UART3,
+	};
+
+	return scu_writev(ctx->scu, &update, 1);
+}
 
+int ast2400_clk_disable(struct clk *ctx, enum clksrc src)
+{
 	switch (src) {
 	case clk_arm:
 		return scu_writel(ctx->scu, SCU_HW_STRAP, SCU_HW_STRAP_ARM_CLK);
 	case clk_uart3:
-		if ((rc = scu_readl(ctx->scu, SCU_CLK_STOP, &reg)) < 0)
-			return rc;
-
-		reg |= SCU_CLK_STOP_UART3;
-
-		if ((rc = scu_writel(ctx->scu, SCU_CLK_STOP, reg)) < 0)
-			return rc;
-
-		return 0;
+		return scu_update_uart3(ctx, SCU_CLK_STOP_UART3);
 	default:
 		break;
 	}
@@ -150,23 +152,12 @@ int ast2400_clk_disable(struct clk *ctx, enum clksrc src)
 
 int ast2400_clk_enable(struct clk *ctx, enum clksrc src)
 {
-	uint32_t reg;
-	int rc;
-
 	switch (src) {
 	case clk_arm:
 		return scu_writel(ctx->scu, SCU_SILICON_REVISION,
 				  SCU_HW_STRAP_ARM_CLK);
 	case clk_uart3:
-		if ((rc = scu_readl(ctx->scu, SCU_CLK_STOP, &reg)) < 0)
-			return rc;
-
-		reg &= ~SCU_CLK_STOP_UART3;
-
-		if ((rc = scu_writel(ctx->scu, SCU_CLK_STOP, reg)) < 0)
-			return rc;
-
-		return 0;
+		return scu_update_uart3(ctx, 0);
 	default:
 		break;
 	}
@@ -182,18 +173,24 @@ static const struct clk_ops ast2400_clk_ops = {
 
 int64_t ast2500_clk_rate_ahb(struct clk *ctx)
 {
+	struct ahb_vec regs[] = {
+		AHB_VEC_L(SCU_HW_STRAP, 0),
+		AHB_VEC_L(AST2500_SCU_H_PLL, 0),
+	};
 	union ast2500_h_pll_reg h_pll_reg;
 	uint32_t strap, ahb_ratio, h_pll, hclk;
 	bool clk_25mhz;
 	int rc;
 
-	/* HW strapping gives us CLKIN and the AHB divisor */
-	if ((rc = scu_readl(ctx->scu, SCU_HW_STRAP, &strap)) < 0)
+	/*
+	 * HW strapping gives us CLKIN and the AHB divisor, and the H-PLL
+	 * register allows us to calculate the CPU freq
+	 */
+	if ((rc = scu_readv(ctx->scu, regs, ARRAY_SIZE(regs))) < 0)
 		return rc;
 
-	/* The H-PLL register allows us to calculate the CPU freq */
-	if ((rc = scu_readl(ctx->scu, AST2500_SCU_H_PLL, &h_pll_reg.w)) < 0)
-		return rc;
+	strap = regs[0].val;
+	h_pll_reg.w = regs[1].val;
 
 	clk_25mhz = strap & SCU_HW_STRAP_CLKIN_IN_MOD;
 	logt("clk: ast2500: clk is %d MHz\n", (clk_25mhz ? 25 : 24));
@@ -227,22 +224,11 @@ int64_t ast2500_clk_rate_ahb(struct clk *ctx)
 
 int ast2500_clk_disable(struct clk *ctx, enum clksrc src)
 {
-	uint32_t reg;
-	int rc;
-
 	switch (src) {
 	case clk_arm:
 		return scu_writel(ctx->scu, SCU_HW_STRAP, SCU_HW_STRAP_ARM_CLK);
 	case clk_uart3:
-		if ((rc = scu_readl(ctx->scu, SCU_CLK_STOP, &reg)) < 0)
-			return rc;
-
-		reg |= SCU_CLK_STOP_UART3;
-
-		if ((rc = scu_writel(ctx->scu, SCU_CLK_STOP, reg)) < 0)
-			return rc;
-
-		return 0;
+		return scu_update_uart3(ctx, SCU_CLK_STOP_UART3);
 	default:
 		break;
 	}
@@ -252,23 +238,12 @@ int ast2500_clk_disable(struct clk *ctx, enum clksrc src)
 
 int ast2500_clk_enable(struct clk *ctx, enum clksrc src)
 {
-	uint32_t reg;
-	int rc;
-
 	switch (src) {
 	case clk_arm:
 		return scu_writel(ctx->scu, SCU_SILICON_REVISION,
 				  SCU_HW_STRAP_ARM_CLK);
 	case clk_uart3:
-		if ((rc = scu_readl(ctx->scu, SCU_CLK_STOP, &reg)) < 0)
-			return rc;
-
-		reg &= ~SCU_CLK_STOP_UART3;
-
-		if ((rc = scu_writel(ctx->scu, SCU_CLK_STOP, reg)) < 0)
-			return rc;
-
-		return 0;
+		return scu_update_uart3(ctx, 0);
 	default:
 		break;
 	}
@@ -284,17 +259,21 @@ static const struct clk_ops ast2500_clk_ops = {
 
 static int64_t ast2600_clk_rate_ahb(struct clk *ctx)
 {
+	struct ahb_vec regs[] = {
+		AHB_VEC_L(AST2600_SCU_HW_STRAP1, 0),
+		AHB_VEC_L(AST2600_SCU_H_PLL, 0),
+	};
 	union ast2600_h_pll_reg h_pll_reg;
 	uint32_t strap, ahb_ratio, cpu_axi_ratio, h_pll, hclk;
 	int rc;
 
-	if ((rc = scu_readl(ctx->scu, AST2600_SCU_HW_STRAP1, &strap)) < 0)
-		return rc;
-
 	/* The H-PLL register allows us to calculate the CPU freq */
-	if ((rc = scu_readl(ctx->scu, AST2600_SCU_H_PLL, &h_pll_reg.w)) < 0)
+	if ((rc = scu_readv(ctx->scu, regs, ARRAY_SIZE(regs))) < 0)
 		return rc;
 
+	strap = regs[0].val;
+	h_pll_reg.w = regs[1].val;
+
 	/* H-PLL = CLKIN (always 25 MHz) * (M+1/N+1) / P+1 */
 	h_pll = 25 * (h_pll_reg.b.m + 1) / (h_pll_reg.b.n + 1) /
 		(h_pll_reg.b.p + 1);
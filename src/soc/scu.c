@@ -2,11 +2,35 @@
 
 #include <errno.h>
 
+#include "array.h"
 #include "scu.h"
 
 #define AST_SCU_PROT_KEY 0x000
 #define AST_SCU_PASSWORD 0x1688a8a8
 
+/*
+ * Keys, W1C status, set/clear pairs and registers updated by the hardware
+ * can't be cached
+ */
+static const struct soc_cache_range ast2500_scu_volatiles[] = {
+	{ 0x000, 0x004 }, /* Protection key */
+	{ 0x010, 0x018 }, /* Frequency counter control, status and result */
+	{ 0x018, 0x01c }, /* Interrupt status */
+	{ 0x03c, 0x040 }, /* Reset status */
+	{ 0x070, 0x074 }, /* Hardware strap, W1S on the AST2500 */
+	{ 0x074, 0x07c }, /* Random number generator control and data */
+	{ 0x07c, 0x080 }, /* Silicon revision, W1C for the strap */
+};
+
+static const struct soc_cache_range ast2600_scu_volatiles[] = {
+	{ 0x000, 0x020 }, /* Protection keys, silicon revisions */
+	{ 0x040, 0x080 }, /* Reset control set/clear pairs, reset event logs */
+	{ 0x080, 0x0a0 }, /* Clock stop set/clear pairs */
+	{ 0x500, 0x520 }, /* Hardware strap set/clear pairs and protection */
+	{ 0x520, 0x528 }, /* Random number generator control and data */
+	{ 0x560, 0x580 }, /* Interrupt control and status */
+};
+
 struct scu {
 	int refcnt;
 	bool was_locked;
@@ -24,6 +48,36 @@ int scu_writel(struct scu *ctx, uint32_t reg, uint32_t value)
 	return soc_writel(ctx->soc, ctx->regs.start + reg, value);
 }
 
+static void scu_rebase(struct ahb_vec *vec, size_t n, int64_t delta)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		vec[i].phys += delta;
+}
+
+int scu_readv(struct scu *ctx, struct ahb_vec *vec, size_t n)
+{
+	int rc;
+
+	scu_rebase(vec, n, ctx->regs.start);
+	rc = soc_readv(ctx->soc, vec, n);
+	scu_rebase(vec, n, -(int64_t)ctx->regs.start);
+
+	return rc;
+}
+
+int scu_writev(struct scu *ctx, struct ahb_vec *vec, size_t n)
+{
+	int rc;
+
+	scu_rebase(vec, n, ctx->regs.start);
+	rc = soc_writev(ctx->soc, vec, n);
+	scu_rebase(vec, n, -(int64_t)ctx->regs.start);
+
+	return rc;
+}
+
 static int scu_is_locked(struct scu *ctx, bool *locked)
 {
 	uint32_t value;
@@ -61,6 +115,15 @@ static int scu_driver_init(struct soc *soc, struct soc_device *dev)
 	ctx->refcnt = 1;
 	ctx->soc = soc;
 
+	if (soc_generation(soc) == ast_g6)
+		rc = soc_cache_region(soc, &ctx->regs, ast2600_scu_volatiles,
+				      ARRAY_SIZE(ast2600_scu_volatiles));
+	else
+		rc = soc_cache_region(soc, &ctx->regs, ast2500_scu_volatiles,
+				      ARRAY_SIZE(ast2500_scu_volatiles));
+	if (rc < 0)
+		logd("Failed to cache SCU registers: %d\n", rc);
+
 	if ((rc = scu_is_locked(ctx, &ctx->was_locked)) < 0) {
 		goto cleanup_ctx;
 	}
@@ -13,4 +13,8 @@ void scu_put(struct scu *ctx);
 int scu_readl(struct scu *ctx, uint32_t reg, uint32_t *val);
 int scu_writel(struct scu *ctx, uint32_t reg, uint32_t val);
 
+/* @vec[].phys holds SCU register offsets rather than absolute addresses */
+int scu_readv(struct scu *ctx, struct ahb_vec *vec, size_t n);
+int scu_writev(struct scu *ctx, struct ahb_vec *vec, size_t n);
+
 #endif
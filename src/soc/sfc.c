@@ -5,6 +5,7 @@
 /* Code shamelessly stolen from skiboot and then hacked to death */
 
 #define _GNU_SOURCE
+#include "array.h"
 #include "ast.h"
 #include "bits.h"
 #include "clk.h"
@@ -178,42 +179,34 @@ static int fl_wren(struct sfc *ct)
 
 static int sfc_start_cmd(struct sfc_data *ct, uint8_t cmd)
 {
-	int rc;
-
-	/* Switch to user mode, CE# dropped */
-	rc = sfc_writel(ct, ct->ctl_reg, ct->ctl_val | 7);
-	if (rc < 0)
-		return rc;
-
-	/* user mode, CE# active */
-	rc = sfc_writel(ct, ct->ctl_reg, ct->ctl_val | 3);
-	if (rc < 0)
-		return rc;
-
-	/* write cmd */
-	rc = flash_write(ct, 0, &cmd, 1);
-
-	return rc == 1 ? 0 : rc;
+	const uint32_t ctl = ct->iomem.start + ct->ctl_reg;
+	const struct ahb_vec seq[] = {
+		/* Switch to user mode, CE# dropped */
+		AHB_VEC_L(ctl, ct->ctl_val | 7),
+		/* user mode, CE# active */
+		AHB_VEC_L(ctl, ct->ctl_val | 3),
+		/* write cmd */
+		{ .phys = ct->flash.start, .width = 1, .val = cmd },
+	};
+
+	return soc_writev(ct->soc, seq, ARRAY_SIZE(seq));
 }
 
 static void sfc_end_cmd(struct sfc_data *ct)
 {
+	const uint32_t ctl = ct->iomem.start + ct->ctl_reg;
+	const struct ahb_vec seq[] = {
+		/* clear CE# */
+		AHB_VEC_L(ctl, ct->ctl_val | 7),
+		/* Switch back to read mode */
+		AHB_VEC_L(ctl, ct->ctl_read_val),
+	};
 	int rc;
 
-	/* clear CE# */
-	rc = sfc_writel(ct, ct->ctl_reg, ct->ctl_val | 7);
+	rc = soc_writev(ct->soc, seq, ARRAY_SIZE(seq));
 	if (rc < 0) {
 		errno = -rc;
-		perror("sfc_writel");
-		return;
-	}
-
-	/* Switch back to read mode */
-	rc = sfc_writel(ct, ct->ctl_reg, ct->ctl_read_val);
-	if (rc < 0) {
-		errno = -rc;
-		perror("sfc_writel");
-		return;
+		perror("soc_writev");
 	}
 }
 
@@ -269,28 +262,31 @@ static int sfc_cmd_rd(struct sfc *ctrl, uint8_t cmd, bool has_addr,
 		 * Writes don't have this problem, thankfully.
 		 */
 		while (size) {
+			struct ahb_vec seq[16];
 			uint8_t *buf = buffer;
-			uint32_t val = 0;
+			size_t j, n;
+
+			n = (size + 3) / 4;
+			if (n > ARRAY_SIZE(seq))
+				n = ARRAY_SIZE(seq);
 
-			rc = soc_readl(ct->soc, ct->flash.start, &val);
+			for (j = 0; j < n; j++) {
+				seq[j].phys = ct->flash.start;
+				seq[j].width = 4;
+			}
+
+			rc = soc_readv(ct->soc, seq, n);
 			if (rc)
 				goto bail;
 
-			if (size) {
-				buf[i++] = (val >> 0) & 0xff;
-				size--;
-			}
-			if (size) {
-				buf[i++] = (val >> 8) & 0xff;
-				size--;
-			}
-			if (size) {
-				buf[i++] = (val >> 16) & 0xff;
-				size--;
-			}
-			if (size) {
-				buf[i++] = (val >> 24) & 0xff;
-				size--;
+			for (j = 0; j < n; j++) {
+				uint32_t val = seq[j].val;
+				int k;
+
+				for (k = 0; k < 4 && size; k++) {
+					buf[i++] = (val >> (8 * k)) & 0xff;
+					size--;
+				}
 			}
 		}
 		rc = 0;
@@ -2,6 +2,7 @@
 // Copyright (C) 2022 IBM Corp.
 
 #include "log.h"
+#include "sio.h"
 #include "soc/sioctl.h"
 #include "soc/strap.h"
 
@@ -35,6 +36,9 @@ int sioctl_decode_configure(struct sioctl *ctx, const enum sioctl_decode mode)
 {
 	int rc;
 
+	/* Whatever the outcome, what we probed before may no longer hold */
+	sio_forget();
+
 	if (mode == sioctl_decode_disable) {
 		return strap_set(ctx->strap, ctx->pdata->reg,
 				 ctx->pdata->disable, ctx->pdata->disable);
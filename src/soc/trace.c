@@ -8,6 +8,7 @@
 #include <stdint.h>
 
 #include "ahb.h"
+#include "array.h"
 #include "ast.h"
 #include "bits.h"
 #include "log.h"
@@ -120,11 +121,34 @@ static int ahbc_writel(struct trace *ctx, uint32_t off, uint32_t val)
 	return soc_writel(ctx->soc, ctx->ahbc.start + off, val);
 }
 
+static int trace_zero_buffer(struct trace *ctx)
+{
+	struct ahb_vec seq[256];
+	size_t i, j, n, words;
+	int rc;
+
+	words = ctx->sram.length / 4;
+	for (i = 0; i < words; i += n) {
+		n = words - i;
+		if (n > ARRAY_SIZE(seq))
+			n = ARRAY_SIZE(seq);
+
+		for (j = 0; j < n; j++)
+			seq[j] = (struct ahb_vec)AHB_VEC_L(
+				ctx->sram.start + 4 * (i + j), 0);
+
+		if ((rc = soc_writev(ctx->soc, seq, n)) < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
 int trace_start(struct trace *ctx, uint32_t addr, int width,
 		enum trace_mode mode)
 {
+	struct ahb_vec setup[2];
 	uint32_t csr, buf;
-	size_t i;
 	int rc;
 
 	logd("%s: 0x%08" PRIx32 " %d %d\n", __func__, addr, width, mode);
@@ -133,18 +157,18 @@ int trace_start(struct trace *ctx, uint32_t addr, int width,
 	csr = AHBC_BCR_CSR_BUF_LEN_32K << AHBC_BCR_CSR_BUF_LEN_SHIFT;
 	csr |= AHBC_BCR_CSR_POLL_MODE * mode;
 
-	if ((rc = ahbc_writel(ctx, R_AHBC_BCR_CSR, csr)))
-		return rc;
-
-	if ((rc = ahbc_writel(ctx, R_AHBC_BCR_ADDR, addr & ~3)))
+	setup[0] = (struct ahb_vec)AHB_VEC_L(ctx->ahbc.start + R_AHBC_BCR_CSR,
+					     csr);
+	setup[1] = (struct ahb_vec)AHB_VEC_L(ctx->ahbc.start + R_AHBC_BCR_ADDR,
+					     addr & ~3);
+	if ((rc = soc_writev(ctx->soc, setup, ARRAY_SIZE(setup))))
 		return rc;
 
 	logi("Zeroing trace buffer [%p - %p]\n", ctx->sram.start,
 	     ctx->sram.start + ctx->sram.length);
 
-	for (i = 0; i < (ctx->sram.length / 4); i++) {
-		soc_writel(ctx->soc, 4 * i + ctx->sram.start, 0);
-	}
+	if ((rc = trace_zero_buffer(ctx)))
+		return rc;
 
 	buf = ctx->sram.start | AHBC_BCR_BUF_WRAP;
 	if ((rc = ahbc_writel(ctx, R_AHBC_BCR_BUF, buf)))
@@ -255,6 +279,13 @@ int trace_dump(struct trace *ctx, int outfd)
 	return rc;
 }
 
+int trace_get_buffer(struct trace *ctx, struct soc_region *buffer)
+{
+	*buffer = ctx->sram;
+
+	return 0;
+}
+
 static const struct soc_device_id ahbc_match[] = {
 	{ .compatible = "aspeed,ast2500-ahb-controller" },
 	{ .compatible = "aspeed,ast2600-ahb-controller" },
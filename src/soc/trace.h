@@ -17,6 +17,9 @@ int trace_start(struct trace *ctx, uint32_t addr, int width,
 int trace_stop(struct trace *ctx);
 int trace_dump(struct trace *ctx, int outfd);
 
+/* The SRAM backing the trace buffer, only safe to use while tracing is idle */
+int trace_get_buffer(struct trace *ctx, struct soc_region *buffer);
+
 struct trace *trace_get(struct soc *soc);
 
 #endif
@@ -285,6 +285,7 @@ static const struct soc_device_id lpc_match[] = {
 
 static int uart_mux_driver_init(struct soc *soc, struct soc_device *dev)
 {
+	struct soc_region routing;
 	struct uart_mux *ctx;
 	uint32_t val;
 	int rc;
@@ -300,6 +301,15 @@ static int uart_mux_driver_init(struct soc *soc, struct soc_device *dev)
 
 	ctx->soc = soc;
 
+	/*
+	 * The BMC's sysfs routing controls also write these, so they're only
+	 * cached when asked for with --cache-registers
+	 */
+	routing.start = ctx->lpc.start + LPC_HICR9;
+	routing.length = LPC_HICRA + 4 - LPC_HICR9;
+	if ((rc = soc_cache_region(soc, &routing, NULL, 0)) < 0)
+		logd("Failed to cache LPC routing registers: %d\n", rc);
+
 	if ((rc = lpc_readl(ctx, LPC_HICR9, &val)) < 0) {
 		goto cleanup_ctx;
 	}
@@ -2,6 +2,7 @@
 // Copyright (C) 2020 IBM Corp.
 
 #define _GNU_SOURCE
+#include "bridge.h"
 #include "compiler.h"
 #include "log.h"
 #include "prompt.h"
@@ -53,6 +54,9 @@ static int ts16_control_init(struct ts16 *ctx, const char *ip,
 		goto cleanup_concentrator;
 	};
 
+	/* The login is made from debug-uart's probe, which may be abandoned */
+	prompt_set_cancel(&ctx->concentrator, bridge_probe_cancel_fd());
+
 	logi("Logging into Digi Portserver TS\n");
 	rc = prompt_expect_run(&ctx->concentrator, "login: ", username);
 	if (rc < 0) {
@@ -90,6 +94,8 @@ static int ts16_control_init(struct ts16 *ctx, const char *ip,
 		goto cleanup_port;
 	}
 
+	prompt_set_cancel(&ctx->concentrator, -1);
+
 	sleep(1);
 
 	return 0;
@@ -149,40 +149,49 @@ static int __suart_init(struct suart *ctx, enum sio_dev dev, bool defaults,
 		return rc;
 
 	/* Disable interrupts, will be polling */
-	rc = lpc_writeb(io, ctx->base + UART_IER, 0);
+	rc = lpc_queue_writeb(io, ctx->base + UART_IER, 0);
 	if (rc)
 		goto cleanup_lpc;
 
 	/* Setup Loop/DTR/RTS signal control */
-	rc = lpc_writeb(io, ctx->base + UART_MCR,
-			(UART_MCR_OUT2 | UART_MCR_NRTS | UART_MCR_NDTR));
+	rc = lpc_queue_writeb(io, ctx->base + UART_MCR,
+			      (UART_MCR_OUT2 | UART_MCR_NRTS | UART_MCR_NDTR));
 	if (rc)
 		goto cleanup_lpc;
 
 	/* Configure 115200 8N1 */
 	divisor = baud_to_divisor(UART_DEFAULT_BAUD);
-	rc = lpc_writeb(io, ctx->base + UART_LCR,
-			(UART_LCR_DLAB | UART_LCR_EPS | UART_LCR_CLS_8));
+	rc = lpc_queue_writeb(io, ctx->base + UART_LCR,
+			      (UART_LCR_DLAB | UART_LCR_EPS | UART_LCR_CLS_8));
 	if (rc)
 		goto cleanup_lpc;
 
-	rc = lpc_writeb(io, ctx->base + UART_DLH, (uint8_t)(divisor >> 8));
+	rc = lpc_queue_writeb(io, ctx->base + UART_DLH,
+			      (uint8_t)(divisor >> 8));
 	if (rc)
 		goto cleanup_lpc;
 
-	rc = lpc_writeb(io, ctx->base + UART_DLL, divisor & 0xff);
+	rc = lpc_queue_writeb(io, ctx->base + UART_DLL, divisor & 0xff);
 	if (rc)
 		goto cleanup_lpc;
 
-	rc = lpc_writeb(io, ctx->base + UART_LCR,
-			(UART_LCR_EPS | UART_LCR_CLS_8));
+	rc = lpc_queue_writeb(io, ctx->base + UART_LCR,
+			      (UART_LCR_EPS | UART_LCR_CLS_8));
 	if (rc)
 		goto cleanup_lpc;
 
 	/* Polled FIFO Mode */
-	return lpc_writeb(io, ctx->base + UART_FCR,
-			  (UART_FCR_XMIT_RST | UART_FCR_RCVR_RST |
-			   UART_FCR_FIFO_EN));
+	rc = lpc_queue_writeb(io, ctx->base + UART_FCR,
+			      (UART_FCR_XMIT_RST | UART_FCR_RCVR_RST |
+			       UART_FCR_FIFO_EN));
+	if (rc)
+		goto cleanup_lpc;
+
+	rc = lpc_flush(io);
+	if (rc)
+		goto cleanup_lpc;
+
+	return 0;
 
 cleanup_lpc:
 	cleanup = lpc_destroy(io);
@@ -341,8 +350,9 @@ ssize_t suart_write(struct suart *ctx, const char *buf, size_t len)
 	if (!(lsr & UART_LSR_THRE))
 		return len;
 
+	/* Fill the FIFO in one go where the LPC backend can batch accesses */
 	while (len && slots) {
-		rc = lpc_writeb(io, ctx->base + UART_THR, *buf++);
+		rc = lpc_queue_writeb(io, ctx->base + UART_THR, *buf++);
 		if (rc)
 			return rc;
 
@@ -350,6 +360,10 @@ ssize_t suart_write(struct suart *ctx, const char *buf, size_t len)
 		slots--;
 	}
 
+	rc = lpc_flush(io);
+	if (rc)
+		return rc;
+
 	return len;
 }
 